@@ -1,5 +1,8 @@
 #version 330 core
 
+/* FEATURES (defined by the variant, see `Shader::variant`)
+** @param LIFE_BAR: draw the life level over the texture */
+
 /* IN VEC
 ** @param UV: the uv coordinates calculated by hand
 ** Interpolated values from the vertex shaders */
@@ -19,11 +22,13 @@ void main()
 {
     // Output color (color of the texture at the specified UV)
     color = texture(texture_sampler, UV);
-    
+
+#ifdef LIFE_BAR
     // Hardcoded life level
     // To campute the color, use a simple algorithm
     if (UV.x < lifeLevel - 0.04 && UV.y > 0.3 && UV.y < 0.7 && UV.x > 0.04)
     {
         color = vec4(1.0 - lifeLevel, lifeLevel, 0.0, 1.0);
     }
+#endif
 }
\ No newline at end of file
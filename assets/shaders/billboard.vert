@@ -1,5 +1,9 @@
 #version 330 core
 
+/* FEATURES (defined by the variant, see `Shader::variant`)
+** @param CENTERED: the billboard is at the center of the screen (game over, win),
+**     else at the top-right corner (life bar) */
+
 /* IN
 ** @param squareVertices: Input vertex data */
 layout(location = 0) in vec3 squareVertices;
@@ -18,8 +22,12 @@ uniform float billboardWidth;
 void main()
 {
     // The position of center of the billboard
+#ifdef CENTERED
+    vec3 position_center = vec3(0.0f);
+#else
     // Make it always at the top-right corner
     vec3 position_center = vec3(0.95f - billboardLen / 2.0f, 0.95f - billboardWidth / 2.0f, 0.0f);
+#endif
 
     // Compute the vertex data of the billboard
     vec3 position = position_center
@@ -0,0 +1,44 @@
+#version 330 core
+
+/* IN VEC
+** @param FragPos: the fragment position
+** @param Normal: the normal of the blade
+** @param Height: the relative height on the blade
+** @param Tint: the brightness of the blade
+** Interpolated values from the vertex shaders */
+in vec3 FragPos;
+in vec3 Normal;
+in float Height;
+in float Tint;
+
+/* OUT VEC4
+** @param color: ouput color data */
+out vec4 color;
+
+/* UNIFORM BLOCK
+** The data shared by all programs in one frame (see `uniform_blocks.h`) */
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    mat4 lightSpace[NUM_CASCADES];
+    vec3 viewPos;
+    float time;
+    vec3 lightDirection;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+    vec4 cascadeSplits;
+};
+
+const vec3 rootColor = vec3(0.10f, 0.25f, 0.05f);
+const vec3 tipColor = vec3(0.45f, 0.65f, 0.20f);
+
+void main()
+{
+    // Blades are thin, light them from both sides
+    float diffuse = abs(dot(normalize(Normal), -normalize(lightDirection)));
+    vec3 albedo = mix(rootColor, tipColor, Height) * Tint;
+    color = vec4(albedo * (0.35f + 0.65f * diffuse), 1.0f);
+}
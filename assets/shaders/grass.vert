@@ -0,0 +1,80 @@
+#version 330 core
+
+/* LAYOUT
+** IN VEC parameters
+** @param vertex: the blade vertex (x across the blade, y along the blade)
+** @param blade_position: the root of the blade (xyz) and its facing angle (w)
+** @param blade_attribs: the height, LOD rank, wind phase and tint of the blade */
+layout (location = 0) in vec2 vertex;
+layout (location = 1) in vec4 blade_position;
+layout (location = 2) in vec4 blade_attribs;
+
+/* OUT VEC
+** @param FragPos: the fragment position
+** @param Normal: the normal of the blade
+** @param Height: the relative height on the blade (0 at the root, 1 at the tip)
+** @param Tint: the brightness of the blade */
+out vec3 FragPos;
+out vec3 Normal;
+out float Height;
+out float Tint;
+
+/* UNIFORM BLOCK
+** The data shared by all programs in one frame (see `uniform_blocks.h`) */
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    mat4 lightSpace[NUM_CASCADES];
+    vec3 viewPos;
+    float time;
+    vec3 lightDirection;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+    vec4 cascadeSplits;
+};
+
+/* UNIFORM
+** @param windDirection: the direction of the wind
+** @param windStrength: how far the tips bend
+** @param lod: the density LOD (near distance, far distance, least density) */
+uniform vec3 windDirection;
+uniform float windStrength;
+uniform vec3 lod;
+
+const float bladeWidth = 0.06f;
+
+void main()
+{
+    vec3 root = blade_position.xyz;
+    float angle = blade_position.w;
+    float height = blade_attribs.x;
+
+    // Thin the field with the distance: drop the blades whose rank is above the density
+    // (all vertices outside the clip volume, so the blade is clipped)
+    float density = mix(1.0f, lod.z, smoothstep(lod.x, lod.y, distance(root, viewPos)));
+    if (blade_attribs.y >= density) {
+        gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);
+        return;
+    }
+    // Shrink the blades close to the threshold so they do not pop
+    float shrink = clamp((density - blade_attribs.y) * 20.0f, 0.0f, 1.0f);
+
+    // Build the blade in its facing direction
+    vec3 right = vec3(cos(angle), 0.0f, sin(angle));
+    vec3 position = root
+                  + right * vertex.x * bladeWidth * shrink
+                  + vec3(0.0f, vertex.y * height * shrink, 0.0f);
+
+    // Sway: the tips bend the most, gusts travel across the field
+    float gust = 0.6f + 0.4f * sin(1.7f * time + blade_attribs.z + 0.15f * (root.x + root.z));
+    position += windDirection * windStrength * gust * vertex.y * vertex.y * height;
+
+    gl_Position = viewProj * vec4(position, 1.0f);
+    FragPos = position;
+    Normal = normalize(vec3(-right.z, 0.5f, right.x));
+    Height = vertex.y;
+    Tint = blade_attribs.w;
+}
@@ -0,0 +1,60 @@
+#version 330 core
+
+/* IN VEC
+** @param FragPos: the position on the quad
+** @param UV: the coordinates in the atlases
+** @param Toward: the direction from the placement to the camera (horizontal)
+** @param Radius: the radius of the placement
+** @param ToWorld: turns the baked normals into world space */
+in vec3 FragPos;
+in vec2 UV;
+flat in vec3 Toward;
+flat in float Radius;
+flat in mat3 ToWorld;
+
+/* OUT VEC
+** @param color: output the color vector */
+out vec4 color;
+
+/* UNIFORM BLOCK
+** The data shared by all programs in one frame (see `uniform_blocks.h`) */
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    mat4 lightSpace[NUM_CASCADES];
+    vec3 viewPos;
+    float time;
+    vec3 lightDirection;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+    vec4 cascadeSplits;
+};
+
+/* UNIFORM
+** @param albedoAtlas: the baked albedo (the alpha marks the model)
+** @param normalAtlas: the baked normal (RGB) and depth (A)
+** @param kd: the diffuse coefficient of the model (as in main.frag) */
+uniform sampler2D albedoAtlas;
+uniform sampler2D normalAtlas;
+uniform float kd;
+
+void main()
+{
+    vec4 albedo = texture(albedoAtlas, UV);
+    if (albedo.a < 0.5f) discard;
+    vec4 normalDepth = texture(normalAtlas, UV);
+
+    // Move the fragment to the baked surface: the baked depth 0.5 is the plane of the
+    // quad, 0 and 1 are @Radius toward and away from the camera
+    vec3 position = FragPos - Toward * (2.0f * normalDepth.a - 1.0f) * Radius;
+    vec4 clip = viewProj * vec4(position, 1.0f);
+    gl_FragDepth = 0.5f * (clip.z / clip.w) + 0.5f;
+
+    // The diffuse light of main.frag (the models have no specular)
+    vec3 normal = normalize(ToWorld * (normalDepth.rgb * 2.0f - 1.0f));
+    float diff = max(dot(normal, normalize(-lightDirection)), 0.0f);
+    color = vec4((1.0f - kd) * lightAmbient * albedo.rgb + kd * lightDiffuse * diff * albedo.rgb, 1.0f);
+}
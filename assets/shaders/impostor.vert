@@ -0,0 +1,69 @@
+#version 330 core
+
+/* LAYOUT
+** IN VEC parameters
+** @param corner: the corner of the quad, in [-1, 1]
+** @param placement: turns the upright model around its y axis, scales and moves it
+**     (see `Impostor::setInstances`) */
+layout (location = 0) in vec2 corner;
+layout (location = 5) in mat4 placement;
+
+/* OUT VEC
+** @param FragPos: the position on the quad
+** @param UV: the coordinates in the atlases
+** @param Toward: the direction from the placement to the camera (horizontal)
+** @param Radius: the radius of the placement
+** @param ToWorld: turns the baked normals into world space */
+out vec3 FragPos;
+out vec2 UV;
+flat out vec3 Toward;
+flat out float Radius;
+flat out mat3 ToWorld;
+
+/* UNIFORM BLOCK
+** The data shared by all programs in one frame (see `uniform_blocks.h`) */
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    mat4 lightSpace[NUM_CASCADES];
+    vec3 viewPos;
+    float time;
+    vec3 lightDirection;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+    vec4 cascadeSplits;
+};
+
+/* UNIFORM
+** @param numViews: the number of views side by side in the atlases
+** @param bounds: the bounding sphere of the upright model (center, radius) */
+uniform int numViews;
+uniform vec4 bounds;
+
+void main()
+{
+    // The quad turns around the up axis of the placement to face the camera
+    vec3 center = vec3(placement * vec4(bounds.xyz, 1.0f));
+    float scale = length(placement[0].xyz);
+    vec3 up = normalize(placement[1].xyz);
+    vec3 toCamera = viewPos - center;
+    vec3 toward = toCamera - dot(toCamera, up) * up;
+    toward = length(toward) > 0.0001f ? normalize(toward) : normalize(placement[2].xyz);
+    vec3 right = cross(up, toward);
+
+    // The view baked nearest to the direction of the camera (view i is baked from the
+    // azimuth 2 * pi * i / numViews of the upright model)
+    vec3 local = transpose(mat3(placement)) * toward;
+    int view = int(floor(atan(local.x, local.z) * float(numViews) / 6.2831853f + 0.5f));
+    view = (view % numViews + numViews) % numViews;
+
+    Radius = bounds.w * scale;
+    FragPos = center + (corner.x * right + corner.y * up) * Radius;
+    UV = vec2((float(view) + 0.5f * corner.x + 0.5f) / float(numViews), 0.5f * corner.y + 0.5f);
+    Toward = toward;
+    ToWorld = mat3(placement) / scale;
+    gl_Position = viewProj * vec4(FragPos, 1.0f);
+}
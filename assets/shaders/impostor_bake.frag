@@ -0,0 +1,32 @@
+#version 330 core
+
+/* IN VEC
+** @param Normal: the normal in the upright space of the model
+** @param TexCoord: the texture coordinates */
+in vec3 Normal;
+in vec2 TexCoord;
+
+/* OUT VEC
+** @param albedo: the albedo atlas (the alpha marks the model)
+** @param normalDepth: the normal atlas (normal in RGB, linear depth of the view in A) */
+layout (location = 0) out vec4 albedo;
+layout (location = 1) out vec4 normalDepth;
+
+/* MATERIAL: The textures of the model (see `Mesh::bindTextures`) */
+struct Material
+{
+    sampler2D diffuse1;
+    sampler2D specular1;
+};
+
+/* UNIFORM
+** @param material: The material textures */
+uniform Material material;
+
+void main()
+{
+    albedo = vec4(texture(material.diffuse1, TexCoord).rgb, 1.0f);
+
+    // The view is orthographic, so the window depth is linear in the distance
+    normalDepth = vec4(normalize(Normal) * 0.5f + 0.5f, gl_FragCoord.z);
+}
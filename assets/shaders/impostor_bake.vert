@@ -0,0 +1,38 @@
+#version 330 core
+
+/* LAYOUT
+** IN VEC parameters
+** @param position: the position data
+** @param normal: the normals of vertices
+** @param texCoord: the coordinates of texture */
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 texCoord;
+
+/* OUT VEC
+** @param Normal: the normal in the upright space of the model
+** @param TexCoord: the texture coordinates */
+out vec3 Normal;
+out vec2 TexCoord;
+
+/* UNIFORM BLOCK
+** The model matrix (the upright orientation, see `Impostor::bake`) and its normal matrix */
+layout (std140) uniform ObjectData
+{
+    mat4 model;
+    mat4 normalMatrix;
+    float kd;
+    float ks;
+    float shininess;
+};
+
+/* UNIFORM
+** @param viewProj: the orthographic camera of the view being baked */
+uniform mat4 viewProj;
+
+void main()
+{
+    gl_Position = viewProj * model * vec4(position, 1.0f);
+    Normal = mat3(normalMatrix) * normal;
+    TexCoord = texCoord;
+}
@@ -1,16 +1,22 @@
 #version 330 core
 
+/* FEATURES (defined by the variant, see `Shader::variant`)
+** @param SHADOWS: the objects are shadowed (see `ComputeShadowDirLight`)
+** @param PCF_KERNEL: the number of hardware PCF taps along each axis (default 2)
+** @param SNOW_BLEND: the surface is blended with snow (see @factor)
+** @param NUM_CASCADES: the number of shadow cascades (always defined, see `NUM_SHADOW_CASCADES`) */
+#ifndef PCF_KERNEL
+#define PCF_KERNEL 2
+#endif
+
 /* STRUCTS: Scene layout */
-/* MATERIAL: The variables about diffuse, specular and shininess.
-**     All members here are related to light settings */
+/* MATERIAL: The textures of the material
+**     The coefficients of diffuse, specular and shininess are in the block `ObjectData` */
 struct Material
 {
     // Sampler variables
     sampler2D diffuse1;
     sampler2D specular1;
-
-    // The coefficients of diffuse, specular and shininess
-    float kd, ks, shininess;
 }; 
 
 /* Light: The variables about light settings
@@ -29,12 +35,16 @@ struct Light
 ** @param FragPos: The position of fragments
 ** @param Normal: The normal of vertices
 ** @param TexCoord: The coordinates of textures 
-** @param FragPosLightSpace: The light space of given fragment position 
+** @param FragPosLightSpace: The position in the light space of each shadow cascade
+** @param ViewDepth: The distance to the camera along the view direction
 ******************************/
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoord;
-in vec4 FragPosLightSpace;
+#ifdef SHADOWS
+in vec4 FragPosLightSpace[NUM_CASCADES];
+in float ViewDepth;
+#endif
 
 /* OUT VEC
 ** @param color: output the color vector */
@@ -42,77 +52,129 @@ out vec4 color;
 
 /****************
 ** UNIFORM
-** @param light: The direction of parallel light
-** @param material: The material setting
-** @param viewPos: The view vector
-** @param shadowMap: The shadow map pf the current scene
+** @param material: The material textures
+** @param shadowMap: The shadow map pf the current scene (the cascades side by side),
+**     sampled with depth comparison (each tap is a bilinear 2x2 PCF)
 ** @param snowMap: The snow map (will be mixed after snow)
-** @param factor: The mixed factor
+** @param factor: The mixed factor (the max snow cover)
+** @param snowAccumMap: The accumulated snow depth (world space, x-z plane)
+** @param snowRegion: The region covered by snowAccumMap (origin x, origin z, size x, size z)
 ****************/
-uniform Light light;
 uniform Material material; 
-uniform vec3 viewPos;
-uniform sampler2D shadowMap;
+#ifdef SHADOWS
+uniform sampler2DShadow shadowMap;
+#endif
+#ifdef SNOW_BLEND
 uniform sampler2D snowMap;
 uniform float factor;
+uniform sampler2D snowAccumMap;
+uniform vec4 snowRegion;
+#endif
+
+/* UNIFORM BLOCK
+** The data shared by all programs in one frame (see `uniform_blocks.h`) */
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    mat4 lightSpace[NUM_CASCADES];
+    vec3 viewPos;
+    float time;
+    vec3 lightDirection;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+    vec4 cascadeSplits;
+};
+
+/* UNIFORM BLOCK
+** The model matrix, its normal matrix and the material of the object being drawn */
+layout (std140) uniform ObjectData
+{
+    mat4 model;
+    mat4 normalMatrix;
+    float kd;
+    float ks;
+    float shininess;
+};
 
 /* Function prototypes
 ** Compute light direction and shadow light direction */
 vec3 ComputeDirLight(Light light, vec3 normal, vec3 viewDir);
-float ComputeShadowDirLight(Light light, vec4 FragPosLightSpace, vec3 normal);
+float ComputeShadowDirLight(Light light, vec3 normal);
 
 /* GLOBAL variable (SHADOW) */
 float shadow = 0.0;
 
 void main()
 {
+    // The parallel light of this frame
+    Light light = Light(lightDirection, lightAmbient, lightDiffuse, lightSpecular);
+
     // Compute shadow light direction
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
-    ComputeShadowDirLight(light, FragPosLightSpace, norm);     
+#ifdef SHADOWS
+    ComputeShadowDirLight(light, norm);
+#endif
     vec3 result = ComputeDirLight(light, norm, viewDir);
     
     // Output color
     color = vec4(result, 1.0);
 }
 
+#ifdef SHADOWS
 /**************
 ** Calcculates the shadow light direction
+** The cascade is picked by the view distance (see `cascadeSplits`), the cascades lay
+** side by side in @shadowMap.
 ** Given parameters:
 ** @param light: The parallel light
-** @param FragPosLightSpace: The light space of given fragment position
 ** @param normal: The normals of vertices
 **************/
-float ComputeShadowDirLight(Light light, vec4 FragPosLightSpace, vec3 normal)
+float ComputeShadowDirLight(Light light, vec3 normal)
 {
-    vec3 projCoords = FragPosLightSpace.xyz / FragPosLightSpace.w;
+    shadow = 0.0;
+    if(ViewDepth > cascadeSplits[NUM_CASCADES - 1]) return shadow;
+    int cascade = 0;
+    while(cascade < NUM_CASCADES - 1 && ViewDepth >= cascadeSplits[cascade])
+        cascade++;
+
+    vec3 projCoords = FragPosLightSpace[cascade].xyz / FragPosLightSpace[cascade].w;
     projCoords = projCoords * 0.5 + 0.5;
 
+    // Keep the shadow at 0.0 outside the light's frustum of the cascade
+    if(projCoords.z > 1.0 || any(lessThan(projCoords.xy, vec2(0.0))) || any(greaterThan(projCoords.xy, vec2(1.0))))
+        return shadow;
+
     // Declare and compute depth
-    float closestDepth = texture(shadowMap, projCoords.xy).r; 
     float currentDepth = projCoords.z;
     vec3 lightDir = normalize(-light.direction);
     float bias = max(0.01 * (1.0 - dot(normal, lightDir)), 0.0005);
 
-    // Compute shadow results
-    shadow = 0.0;
+    // Compute shadow results: PCF_KERNEL x PCF_KERNEL hardware compared taps, 2 texels
+    // apart, each filters 2x2 texels (4 taps cover 4x4 texels). The taps (and their
+    // footprint) are kept inside the tile of the cascade.
     vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; x++)
+    float tileMin = float(cascade) / float(NUM_CASCADES) + PCF_KERNEL * texelSize.x;
+    float tileMax = float(cascade + 1) / float(NUM_CASCADES) - PCF_KERNEL * texelSize.x;
+    vec2 tileCoords = vec2((projCoords.x + float(cascade)) / float(NUM_CASCADES), projCoords.y);
+    for(int x = 1 - PCF_KERNEL; x < PCF_KERNEL; x += 2)
     {
-        for(int y = -1; y <= 1; y++)
+        for(int y = 1 - PCF_KERNEL; y < PCF_KERNEL; y += 2)
         {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
-            shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;        
-        }    
+            vec2 uv = tileCoords + vec2(x, y) * texelSize;
+            uv.x = clamp(uv.x, tileMin, tileMax);
+            shadow += 1.0 - texture(shadowMap, vec3(uv, currentDepth - bias));
+        }
     }
-    shadow /= 9.0;
-    
-    // Keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
-    if(projCoords.z > 1.0) shadow = 0.0;
+    shadow /= float(PCF_KERNEL * PCF_KERNEL);
 
     // Return the shadow result
     return shadow;
 }
+#endif
 
 /**************
 ** Calculates the color when using a directional light.
@@ -130,13 +192,20 @@ vec3 ComputeDirLight(Light light, vec3 normal, vec3 viewDir)
     
     // Specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
     
-    // Combine results
-    vec3 ambient = light.ambient * vec3((1 - factor) * texture(material.diffuse1, TexCoord) + factor * texture(snowMap, TexCoord));
-    vec3 diffuse = light.diffuse * diff * vec3((1 - factor) * texture(material.diffuse1, TexCoord) + factor * texture(snowMap, TexCoord));
+    // Snow covers the surface where snowflakes actually landed
+    // Combine results (each texture is sampled once)
+    vec3 albedo = texture(material.diffuse1, TexCoord).rgb;
+#ifdef SNOW_BLEND
+    vec2 snowUV = (FragPos.xz - snowRegion.xy) / snowRegion.zw;
+    float cover = factor * clamp(texture(snowAccumMap, snowUV).r, 0.0, 1.0);
+    albedo = mix(albedo, texture(snowMap, TexCoord).rgb, cover);
+#endif
+    vec3 ambient = light.ambient * albedo;
+    vec3 diffuse = light.diffuse * diff * albedo;
     vec3 specular = light.specular * spec * vec3(1.0);
 
-    return ((1 - material.kd - material.ks) * ambient 
-          + (1 - shadow) * (material.kd * diffuse + material.ks * specular));
+    return ((1 - kd - ks) * ambient 
+          + (1 - shadow) * (kd * diffuse + ks * specular));
 }
\ No newline at end of file
@@ -1,39 +1,120 @@
 #version 330 core
 
+/* FEATURES (defined by the variant, see `Shader::variant`)
+** @param SHADOWS: output the positions in the light space (shadowed objects)
+** @param DEPTH_ONLY: output the light space position of @cascade only (shadow map)
+** @param NUM_CASCADES: the number of shadow cascades (always defined, see `NUM_SHADOW_CASCADES`) */
+
 /* LAYOUT
 ** IN VEC parameters
 ** @param position: the position data 
 ** @param normal: the normals of vertices
-** @param texCoords: the coordinates of texture */
+** @param texCoords: the coordinates of texture
+** @param instanceModel: the model matrix of the instance (instanced drawing only)
+** @param barrier: the lane, z and rotation phase of the barrier (barrier drawing only) */
 layout (location = 0) in vec3 position;
+#ifndef DEPTH_ONLY
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 texCoord;
+#endif
+layout (location = 5) in mat4 instanceModel;
+layout (location = 9) in vec3 barrier;
 
+#ifndef DEPTH_ONLY
 /* OUT VEC
 ** @param FragPos: the fragment position
 ** @param Normal: the normals of vertices
 ** @param TexCoords: the texture coordinates
-** @param FragPosLightSpace: The light space of given fragment position */
+** @param FragPosLightSpace: The position in the light space of each shadow cascade
+** @param ViewDepth: The distance to the camera along the view direction */
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
-out vec4 FragPosLightSpace;
+#ifdef SHADOWS
+out vec4 FragPosLightSpace[NUM_CASCADES];
+out float ViewDepth;
+#endif
+#endif
+
+/* UNIFORM BLOCK
+** The data shared by all programs in one frame (see `uniform_blocks.h`) */
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    mat4 lightSpace[NUM_CASCADES];
+    vec3 viewPos;
+    float time;
+    vec3 lightDirection;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+    vec4 cascadeSplits;
+};
+
+/* UNIFORM BLOCK
+** The model matrix, its normal matrix and the material of the object being drawn */
+layout (std140) uniform ObjectData
+{
+    mat4 model;
+    mat4 normalMatrix;
+    float kd;
+    float ks;
+    float shininess;
+};
 
 /* UNIFORM
-** @param model: the model matrix
-** @param view: the view matrix
-** @param projection: the projection matrix
-** @param lightSpaceMatrix: the matrix of light space */
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 lightSpaceMatrix;
+** @param cascade: the shadow cascade being rendered (DEPTH_ONLY, index of @lightSpace)
+** @param instanced: whether the model matrix is read from @instanceModel
+** @param barrierInstanced: whether the barrier transform is built from @barrier
+** @param barrierBaseline: the height of barriers
+** @param barrierSpin: the angular speed of barriers (radians per second) */
+#ifdef DEPTH_ONLY
+uniform int cascade;
+#endif
+uniform bool instanced;
+uniform bool barrierInstanced;
+uniform float barrierBaseline;
+uniform float barrierSpin;
+
+/* The transform of a barrier: rotate around y, then move to its lane and row */
+mat4 barrierMatrix()
+{
+    float angle = barrier.z + time * barrierSpin;
+    float c = cos(angle), s = sin(angle);
+    return mat4(c, 0.0f, -s, 0.0f,
+                0.0f, 1.0f, 0.0f, 0.0f,
+                s, 0.0f, c, 0.0f,
+                barrier.x, barrierBaseline, barrier.y, 1.0f);
+}
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f);
-    FragPos = vec3(model * vec4(position, 1.0f));
-    Normal = mat3(transpose(inverse(model))) * normal;
+#ifdef DEPTH_ONLY
+    mat4 M = instanced ? instanceModel : model;
+    if (barrierInstanced) M = barrierMatrix() * model;
+    gl_Position = lightSpace[cascade] * M * vec4(position, 1.0f);
+#else
+    // The normal matrix is supplied per draw (see `ObjectData`). The instance matrices
+    // only rotate and scale uniformly, so their upper 3x3 does for the normals (the
+    // normal is normalized in the fragment shader).
+    mat4 M = instanced ? instanceModel : model;
+    mat3 N = instanced ? mat3(instanceModel) : mat3(normalMatrix);
+    if (barrierInstanced)
+    {
+        mat4 B = barrierMatrix();
+        M = B * model;
+        N = mat3(B) * mat3(normalMatrix);
+    }
+    gl_Position = viewProj * M * vec4(position, 1.0f);
+    FragPos = vec3(M * vec4(position, 1.0f));
+    Normal = N * normal;
     TexCoord = texCoord;
-    FragPosLightSpace = lightSpaceMatrix * vec4(FragPos, 1.0);
+#ifdef SHADOWS
+    for (int i = 0; i < NUM_CASCADES; i++)
+        FragPosLightSpace[i] = lightSpace[i] * vec4(FragPos, 1.0);
+    ViewDepth = -(view * vec4(FragPos, 1.0)).z;
+#endif
+#endif
 }
\ No newline at end of file
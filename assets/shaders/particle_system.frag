@@ -2,8 +2,10 @@
 
 /* IN VEC
 ** @param UV: the uv coordinates calculated by hand
+** @param Fade: the alpha factor from the remaining life
 ** Interpolated values from the vertex shaders */
 in vec2 UV;
+in float Fade;
 
 /* OUT VEC4
 ** @param color: ouput color data */
@@ -16,6 +18,6 @@ uniform sampler2D texture_sampler;
 void main()
 {
     // Output color (color of the texture at the specified UV)
-    // Here the snowflake has white and half-transparent color
-    color = texture(texture_sampler, UV) * vec4(1.0, 1.0, 1.0, 0.7);
+    // Here the snowflake has white and half-transparent color, fading out at the end of its life
+    color = texture(texture_sampler, UV) * vec4(1.0, 1.0, 1.0, 0.7 * Fade);
 }
\ No newline at end of file
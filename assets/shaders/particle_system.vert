@@ -2,36 +2,63 @@
 
 /* LAYOUT
 ** IN VEC parameters
-** @param squareVertices: the vertices data 
+** @param squareVertices: the vertices data (unit quad centered at the origin)
 ** @param squareUVs: the UV coordinates of vertices
-** @param particle_positions_worldspace: the position of particles */
+** @param particle_offset: the position of particles relative to the emitter
+** @param particle_attribs: the size, rotation and fade of particles (normalized) */
 layout(location = 0) in vec3 squareVertices;
 layout(location = 1) in vec2 squareUVs; 
-layout(location = 2) in vec3 particle_positions_worldspace;
+layout(location = 2) in vec3 particle_offset;
+layout(location = 3) in vec3 particle_attribs;
 
 /* OUT VEC
-** @param UV: the UV coordinates */
+** @param UV: the UV coordinates
+** @param Fade: the alpha factor of the particle */
 out vec2 UV;
+out float Fade;
 
 /* UNIFORM
 ** @param CameraRight_worldspace: the right direction of camera
 ** @param CameraUp_worldspace: the up direction of camera
-** @param view: the view matrix
-** @param projection: the projection matrix */
+** @param emitter_position: the position of the particle generator
+** @param max_size: the size of particle when particle_attribs.x == 1 */
 uniform vec3 CameraRight_worldspace;
 uniform vec3 CameraUp_worldspace;
-uniform mat4 view;
-uniform mat4 projection;
+uniform vec3 emitter_position;
+uniform float max_size;
+
+/* UNIFORM BLOCK
+** The data shared by all programs in one frame (see `uniform_blocks.h`) */
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    mat4 lightSpace[NUM_CASCADES];
+    vec3 viewPos;
+    float time;
+    vec3 lightDirection;
+    vec3 lightAmbient;
+    vec3 lightDiffuse;
+    vec3 lightSpecular;
+    vec4 cascadeSplits;
+};
 
 void main()
 {
+    // Decode the packed attributes
+    float size = particle_attribs.x * max_size;
+    float angle = particle_attribs.y * 6.28318531;
+    vec2 corner = mat2(cos(angle), sin(angle), -sin(angle), cos(angle)) * squareVertices.xy * size;
+
     // Compute the position in world space
-    vec3 vertexPosition_worldspace = particle_positions_worldspace
-                                   + CameraRight_worldspace * squareVertices.x
-                                   + CameraUp_worldspace * squareVertices.y;
-    gl_Position = projection * view * vec4(vertexPosition_worldspace, 1.0f);
+    vec3 vertexPosition_worldspace = emitter_position + particle_offset
+                                   + CameraRight_worldspace * corner.x
+                                   + CameraUp_worldspace * corner.y;
+    gl_Position = viewProj * vec4(vertexPosition_worldspace, 1.0f);
 
-    // Output UV coordinates
+    // Output UV coordinates and fade
     UV = squareUVs;
+    Fade = particle_attribs.z;
 }
 
@@ -0,0 +1,20 @@
+#version 330 core
+
+/* IN VEC
+** @param UV: the texture coordinates of the map */
+in vec2 UV;
+
+/* OUT FLOAT
+** @param depth: the snow depth after scrolling and decay */
+out float depth;
+
+/* UNIFORM
+** @param previousMap: the snow map of the last frame
+** @param shiftDecay: the shift of the window (UV units) and the decay factor */
+uniform sampler2D previousMap;
+uniform vec3 shiftDecay;
+
+void main()
+{
+    depth = texture(previousMap, UV + shiftDecay.xy).r * shiftDecay.z;
+}
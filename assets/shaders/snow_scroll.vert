@@ -0,0 +1,16 @@
+#version 330 core
+
+/* LAYOUT
+** IN VEC parameters
+** @param position: the vertices of the full screen quad */
+layout (location = 0) in vec2 position;
+
+/* OUT VEC
+** @param UV: the texture coordinates of the map */
+out vec2 UV;
+
+void main()
+{
+    gl_Position = vec4(position, 0.0, 1.0);
+    UV = position * 0.5 + 0.5;
+}
@@ -0,0 +1,16 @@
+#version 330 core
+
+/* OUT FLOAT
+** @param depth: the snow depth added by this impact */
+out float depth;
+
+/* UNIFORM
+** @param amount: the snow depth added at the center of the impact */
+uniform float amount;
+
+void main()
+{
+    // Soft round splat
+    float falloff = 1.0 - length(gl_PointCoord * 2.0 - 1.0);
+    depth = amount * max(falloff, 0.0);
+}
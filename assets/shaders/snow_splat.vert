@@ -0,0 +1,19 @@
+#version 330 core
+
+/* LAYOUT
+** IN VEC parameters
+** @param position: the impact point (world space) */
+layout (location = 0) in vec3 position;
+
+/* UNIFORM
+** @param region: the covered window (origin x, origin z, size x, size z)
+** @param pointSize: the size of one impact in texels */
+uniform vec4 region;
+uniform float pointSize;
+
+void main()
+{
+    vec2 uv = (position.xz - region.xy) / region.zw;
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+    gl_PointSize = pointSize;
+}
@@ -0,0 +1,39 @@
+# -----------------------------------------------------------------------------
+# Distributed under the GPL-3.0 License.
+# This CMake file is integrated with the whole game project.
+# It embeds the GLSL sources into the executable.
+# --------
+#
+# Run as a script at build time (see `CMakeLists.txt`):
+#   cmake -DSHADER_DIR=<dir> -DOUTPUT=<header> -P EmbedShaders.cmake
+#
+# All `*.vert` and `*.frag` files of SHADER_DIR are written into OUTPUT as a
+# `constexpr` table of (file name, source) pairs, each source is a raw string
+# literal. `Shader::loadCode` looks the shaders up by their file name.
+#
+# --------
+
+if(NOT SHADER_DIR OR NOT OUTPUT)
+  message(FATAL_ERROR "EmbedShaders.cmake: SHADER_DIR and OUTPUT are required")
+endif()
+
+file(GLOB shader_files "${SHADER_DIR}/*.vert" "${SHADER_DIR}/*.frag")
+list(SORT shader_files)
+
+set(content "// Generated by cmake/EmbedShaders.cmake from ${SHADER_DIR}, do not edit.\n")
+string(APPEND content "#ifndef _EMBEDDED_SHADERS_H_\n#define _EMBEDDED_SHADERS_H_\n\n")
+string(APPEND content "#include <string_view>\n\n")
+string(APPEND content "/* STRUCT: A shader source embedded at build time */\n")
+string(APPEND content "struct EmbeddedShader {\n  std::string_view name;\n  std::string_view source;\n};\n\n")
+string(APPEND content "constexpr EmbeddedShader embedded_shaders[] = {\n")
+foreach(shader_file ${shader_files})
+  get_filename_component(shader_name "${shader_file}" NAME)
+  file(READ "${shader_file}" source)
+  string(APPEND content "    {\"${shader_name}\", R\"GLSL_SOURCE(${source})GLSL_SOURCE\"},\n")
+endforeach()
+string(APPEND content "};\n\n#endif\n")
+
+# Only touch the header when it changes (no rebuild otherwise)
+file(WRITE "${OUTPUT}.tmp" "${content}")
+file(COPY_FILE "${OUTPUT}.tmp" "${OUTPUT}" ONLY_IF_DIFFERENT)
+file(REMOVE "${OUTPUT}.tmp")
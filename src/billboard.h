@@ -13,6 +13,7 @@
 
 #include "GL/glew.h"
 #include "camera.h"
+#include "gl_state.h"
 #include "shader.hpp"
 #include "texture.h"
 
@@ -34,21 +35,27 @@ class Billboard {
   const GLint getWidth() { return width; }
   const GLint getHeight() { return height; }
 
+  /* Set the size of the billboard on the screen (normalized device coordinates)
+  ** It is set when drawing, so billboards may share one shader variant. */
+  void setSize(const GLfloat& _len, const GLfloat& _breadth) {
+    len = _len;
+    breadth = _breadth;
+  }
+
   /* Function to draw this billboard */
   void draw(Camera camera, GLuint texture_unit) {
     // Install shader
     shader.install();
-    glBindVertexArray(VAO);
+    glState().bindVertexArray(VAO);
 
     // Enable blend
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glState().enable(GL_BLEND);
+    glState().blendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
     texture.bind(texture_unit);
     shader.setUniform1i("texture_sampler", texture_unit);
+    shader.setUniform1f("billboardLen", len);
+    shader.setUniform1f("billboardWidth", breadth);
     glDrawArrays(GL_TRIANGLES, 0, 6);
-    glDisable(GL_BLEND);
-    glBindVertexArray(0);
-    shader.uninstall();
   }
 
  private:
@@ -58,6 +65,7 @@ class Billboard {
     // Get the width and height of texture
     width = texture.getWidth();
     height = texture.getHeight();
+    setSize(0.001f * width, 0.001f * height);
 
     GLfloat billboard_quad[] =
         {
@@ -72,7 +80,7 @@ class Billboard {
 
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
+    glState().bindVertexArray(VAO);
 
     // The data of VBO is shared by every particle (instancing technique!)
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
@@ -85,7 +93,7 @@ class Billboard {
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    glState().bindVertexArray(0);
   }
 
   /* PRIVATE MEMBER
@@ -100,6 +108,10 @@ class Billboard {
   ** The width and height of billboard image */
   GLint width, height;
 
+  /* PRIVATE MEMBER
+  ** The size on the screen (see `setSize`) */
+  GLfloat len, breadth;
+
   /* PRIVATE MEMBERS
   ** The VAO and VBOs of the particle system */
   GLuint VAO, VBO;
@@ -0,0 +1,165 @@
+/*******************************************************************************
+** Software License Agreement (GNU GENERAL PUBLIC LICENSE)
+**
+** Copyright 2016-2017  Peiyu Liao (enzoliao95@gmail.com). All rights reserved.
+** Copyright 2016-2017  Yaohong Wu (wuyaohongdio@gmail.com). All rights reserved.
+**
+** LICENSE INFORMATION (GPL)
+** SEE `LICENSE` FILE.
+*******************************************************************************/
+
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+/* ENUM TYPE
+** The six planes of a frustum */
+enum FrustumPlane {
+  FRUSTUM_LEFT,
+  FRUSTUM_RIGHT,
+  FRUSTUM_BOTTOM,
+  FRUSTUM_TOP,
+  FRUSTUM_NEAR,
+  FRUSTUM_FAR
+};
+
+/* STRUCT: A bounding sphere
+** Built once from the vertex positions in model space (see `fromPoints`) and moved to
+** world space with `transform`. A negative radius means no bounds (never culled). */
+struct BoundingSphere {
+  glm::vec3 center;
+  GLfloat radius;
+
+  /* Default constructor & Constructor */
+  BoundingSphere() : center(0.0f), radius(-1.0f) {}
+  BoundingSphere(const glm::vec3& _center, const GLfloat& _radius)
+      : center(_center), radius(_radius) {}
+
+  /* The sphere around @count points, read every @stride floats from @data
+  ** It is centered on the bounding box of the points (cheap, and tight enough). */
+  static BoundingSphere fromPoints(const GLfloat* data, const size_t& count, const size_t& stride) {
+    if (count == 0) return BoundingSphere();
+    glm::vec3 box_min(data[0], data[1], data[2]), box_max = box_min;
+    for (size_t i = 1; i < count; ++i) {
+      glm::vec3 point(data[i * stride], data[i * stride + 1], data[i * stride + 2]);
+      box_min = glm::min(box_min, point);
+      box_max = glm::max(box_max, point);
+    }
+
+    glm::vec3 center = 0.5f * (box_min + box_max);
+    GLfloat radius = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+      glm::vec3 point(data[i * stride], data[i * stride + 1], data[i * stride + 2]);
+      radius = glm::max(radius, glm::length(point - center));
+    }
+    return BoundingSphere(center, radius);
+  }
+
+  /* The smallest sphere containing this sphere and @other */
+  BoundingSphere merge(const BoundingSphere& other) const {
+    if (radius < 0.0f) return other;
+    if (other.radius < 0.0f) return *this;
+    GLfloat distance = glm::length(other.center - center);
+    if (distance + other.radius <= radius) return *this;
+    if (distance + radius <= other.radius) return other;
+
+    GLfloat merged = 0.5f * (distance + radius + other.radius);
+    return BoundingSphere(center + (other.center - center) * ((merged - radius) / distance), merged);
+  }
+
+  /* The sphere placed by @model (the radius grows with the largest scale) */
+  BoundingSphere transform(const glm::mat4& model) const {
+    if (radius < 0.0f) return *this;
+    GLfloat scale = glm::max(glm::length(glm::vec3(model[0])),
+                             glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    return BoundingSphere(glm::vec3(model * glm::vec4(center, 1.0f)), radius * scale);
+  }
+};
+
+/* STRUCT: The number of objects drawn and culled by a pass (see `renderScene`) */
+struct CullStats {
+  GLuint drawn = 0, culled = 0;
+
+  /* Count an object, returns @visible */
+  GLboolean count(const GLboolean& visible) {
+    if (visible)
+      drawn++;
+    else
+      culled++;
+    return visible;
+  }
+  void reset() { drawn = culled = 0; }
+};
+
+/* CLASS: Frustum
+** The view volume of a camera (or a light), described by six planes in world space.
+** The planes are extracted from the matrix `projection * view`, so it works for
+** both perspective and orthographic projections. */
+class Frustum {
+ public:
+  /* Default constructor & Constructor */
+  Frustum(const glm::mat4& _matrix = glm::mat4()) {
+    update(_matrix);
+  }
+
+  /* Extract the planes from the given matrix (projection * view)
+  ** Each plane is stored as (normal, distance) with the normal pointing inside. */
+  void update(const glm::mat4& matrix) {
+    // The rows of the matrix (glm matrices are column-major)
+    glm::vec4 row0(matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0]);
+    glm::vec4 row1(matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1]);
+    glm::vec4 row2(matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2]);
+    glm::vec4 row3(matrix[0][3], matrix[1][3], matrix[2][3], matrix[3][3]);
+
+    planes[FRUSTUM_LEFT] = row3 + row0;
+    planes[FRUSTUM_RIGHT] = row3 - row0;
+    planes[FRUSTUM_BOTTOM] = row3 + row1;
+    planes[FRUSTUM_TOP] = row3 - row1;
+    planes[FRUSTUM_NEAR] = row3 + row2;
+    planes[FRUSTUM_FAR] = row3 - row2;
+
+    // Normalize the planes so that distances are in world units
+    for (GLuint i = 0; i < 6; ++i)
+      planes[i] /= glm::length(glm::vec3(planes[i]));
+  }
+
+  /* Returns the private members */
+  const glm::vec4 getPlane(FrustumPlane plane) const { return planes[plane]; }
+
+  /* Test whether a sphere intersects the frustum */
+  GLboolean containsSphere(const glm::vec3& center, GLfloat radius) const {
+    for (GLuint i = 0; i < 6; ++i) {
+      if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+        return false;
+    }
+    return true;
+  }
+
+  /* Test whether a bounding sphere intersects the frustum (no bounds: always) */
+  GLboolean containsSphere(const BoundingSphere& bounds) const {
+    return bounds.radius < 0.0f || containsSphere(bounds.center, bounds.radius);
+  }
+
+  /* Test whether an axis-aligned box intersects the frustum
+  ** Only the corner farthest along each plane normal is tested. */
+  GLboolean containsBox(const glm::vec3& box_min, const glm::vec3& box_max) const {
+    for (GLuint i = 0; i < 6; ++i) {
+      glm::vec3 corner(planes[i].x > 0.0f ? box_max.x : box_min.x,
+                       planes[i].y > 0.0f ? box_max.y : box_min.y,
+                       planes[i].z > 0.0f ? box_max.z : box_min.z);
+      if (glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0.0f)
+        return false;
+    }
+    return true;
+  }
+
+ private:
+  /* PRIVATE MEMBER
+  ** The planes of the frustum: (a, b, c, d) means `a * x + b * y + c * z + d = 0` */
+  glm::vec4 planes[6];
+};
+
+#endif
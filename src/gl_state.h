@@ -0,0 +1,161 @@
+/*******************************************************************************
+** Software License Agreement (GNU GENERAL PUBLIC LICENSE)
+**
+** Copyright 2016-2017  Peiyu Liao (enzoliao95@gmail.com). All rights reserved.
+** Copyright 2016-2017  Yaohong Wu (wuyaohongdio@gmail.com). All rights reserved.
+**
+** LICENSE INFORMATION (GPL)
+** SEE `LICENSE` FILE.
+*******************************************************************************/
+
+#ifndef _GL_STATE_H_
+#define _GL_STATE_H_
+
+#include <GL/glew.h>
+
+/* CLASS: GL state tracker
+** Remembers the program, the VAO, the 2D textures of each unit, blending and depth
+** test, and skips the GL calls which would not change anything. All draw code goes
+** through it, so nobody needs to unbind after drawing.
+** ATTENTION: Do not change these states with raw GL calls, or call `invalidate`. */
+class GLState {
+ public:
+  /* The number of texture units tracked */
+  static const GLuint MAX_UNITS = 32;
+
+  /* Default constructor */
+  GLState() {
+    invalidate();
+    resetCounters();
+    last_issued = last_skipped = 0;
+  }
+
+  /* Returns the counters
+  ** @getIssued, @getSkipped: The calls issued / skipped since the last `endFrame`
+  ** @getLastIssued, @getLastSkipped: The same counters of the last frame */
+  const GLuint getIssued() { return issued; }
+  const GLuint getSkipped() { return skipped; }
+  const GLuint getLastIssued() { return last_issued; }
+  const GLuint getLastSkipped() { return last_skipped; }
+
+  /* Keep the counters of the frame and start counting the next one */
+  void endFrame() {
+    last_issued = issued;
+    last_skipped = skipped;
+    resetCounters();
+  }
+
+  void resetCounters() { issued = skipped = 0; }
+
+  /* Forget everything (the next call of each kind is always issued) */
+  void invalidate() {
+    program = VAO = UNKNOWN;
+    active_unit = UNKNOWN;
+    for (GLuint i = 0; i < MAX_UNITS; ++i) textures[i] = UNKNOWN;
+    blend = depth_test = point_size = UNKNOWN;
+    blend_src = blend_dst = UNKNOWN;
+  }
+
+  /* glUseProgram */
+  void useProgram(const GLuint& _program) {
+    if (!changed(program, _program)) return;
+    glUseProgram(_program);
+  }
+
+  /* glBindVertexArray */
+  void bindVertexArray(const GLuint& _VAO) {
+    if (!changed(VAO, _VAO)) return;
+    glBindVertexArray(_VAO);
+  }
+
+  /* glActiveTexture + glBindTexture(GL_TEXTURE_2D) on texture unit @unit */
+  void bindTexture(const GLuint& unit, const GLuint& texture) {
+    if (!changed(textures[unit], texture)) return;
+    activeTexture(unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+  }
+
+  /* glBindTexture(GL_TEXTURE_2D) on the active unit (e.g. to upload a texture) */
+  void bindTexture(const GLuint& texture) {
+    if (active_unit == UNKNOWN) activeTexture(0);
+    bindTexture(active_unit, texture);
+  }
+
+  /* glEnable / glDisable for GL_BLEND, GL_DEPTH_TEST and GL_PROGRAM_POINT_SIZE */
+  void enable(const GLenum& cap) { setCapability(cap, GL_TRUE); }
+  void disable(const GLenum& cap) { setCapability(cap, GL_FALSE); }
+
+  /* glBlendFunc */
+  void blendFunc(const GLenum& src, const GLenum& dst) {
+    GLboolean same = (blend_src == src && blend_dst == dst);
+    blend_src = src;
+    blend_dst = dst;
+    if (same) {
+      skipped++;
+      return;
+    }
+    issued++;
+    glBlendFunc(src, dst);
+  }
+
+ private:
+  /* The value of a state not known yet */
+  static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+  /* PRIVATE MEMBER
+  ** Update a cached state, count the call and return whether it must be issued */
+  GLboolean changed(GLuint& state, const GLuint& value) {
+    if (state == value) {
+      skipped++;
+      return false;
+    }
+    state = value;
+    issued++;
+    return true;
+  }
+
+  /* PRIVATE MEMBER: glActiveTexture */
+  void activeTexture(const GLuint& unit) {
+    if (!changed(active_unit, unit)) return;
+    glActiveTexture(GL_TEXTURE0 + unit);
+  }
+
+  /* PRIVATE MEMBER: glEnable / glDisable */
+  void setCapability(const GLenum& cap, const GLboolean& on) {
+    GLuint* state = NULL;
+    if (cap == GL_BLEND)
+      state = &blend;
+    else if (cap == GL_DEPTH_TEST)
+      state = &depth_test;
+    else if (cap == GL_PROGRAM_POINT_SIZE)
+      state = &point_size;
+
+    if (state && !changed(*state, on)) return;
+    if (on)
+      glEnable(cap);
+    else
+      glDisable(cap);
+  }
+
+  /* PRIVATE MEMBERS
+  ** The states bound now (UNKNOWN if not known) */
+  GLuint program, VAO;
+  GLuint active_unit;
+  GLuint textures[MAX_UNITS];
+  GLuint blend, depth_test, point_size;
+  GLuint blend_src, blend_dst;
+
+  /* PRIVATE MEMBERS
+  ** The calls issued and skipped (this frame and the last one) */
+  GLuint issued, skipped;
+  GLuint last_issued, last_skipped;
+};
+
+/* The state tracker of the (only) GL context
+** (`inline`: one tracker for the whole program) */
+inline GLState& glState() {
+  static GLState state;
+  return state;
+}
+
+#endif
@@ -0,0 +1,300 @@
+/*******************************************************************************
+** Software License Agreement (GNU GENERAL PUBLIC LICENSE)
+**
+** Copyright 2016-2017  Peiyu Liao (enzoliao95@gmail.com). All rights reserved.
+** Copyright 2016-2017  Yaohong Wu (wuyaohongdio@gmail.com). All rights reserved.
+**
+** LICENSE INFORMATION (GPL)
+** SEE `LICENSE` FILE.
+*******************************************************************************/
+
+#ifndef _GRASS_FIELD_H_
+#define _GRASS_FIELD_H_
+
+#include <GL/glew.h>
+#include <math.h>
+
+#include <chrono>
+#include <future>
+#include <glm/glm.hpp>
+#include <random>
+#include <vector>
+
+#include "frustum.h"
+#include "gl_state.h"
+#include "shader.hpp"
+
+/* STRUCT: The per-instance data of a grass blade (32 bytes)
+** @param position: The root of the blade (world space)
+** @param angle: The facing angle of the blade around the y axis
+** @param height: The height of the blade
+** @param lod_rank: Random rank in [0, 1), blades with larger rank are dropped first
+** @param phase: The phase of the wind sway
+** @param tint: The brightness of the blade */
+struct GrassBlade {
+  GLfloat position[3];
+  GLfloat angle;
+  GLfloat height;
+  GLfloat lod_rank;
+  GLfloat phase;
+  GLfloat tint;
+};
+
+/* STRUCT: A segment of the grass field
+** The world is split into segments of @length along -z, segment `index` covers
+** z from `-length * (index + 1)` to `-length * index`. */
+struct GrassSegment {
+  GLint index;
+  GLboolean visible;
+  GLuint num_blades;
+  GLuint VBO;
+  glm::vec3 box_min, box_max;
+  std::future<std::vector<GrassBlade> > pending;
+};
+
+/* CLASS: Grass field
+** Procedural grass scattered on both sides of the path. Every segment is generated
+** from a seed derived from its index (so a segment always looks the same), on a
+** worker thread. The blades sway with the wind in the vertex shader and are thinned
+** with the distance to the camera, one instanced draw call per segment. */
+class GrassField {
+ public:
+  /* Default constructor & Constructor
+  ** @param _num_slots: The number of segments alive at the same time
+  ** @param _num_blades: The number of blades in one segment
+  ** @param _length: The length of one segment along z
+  ** @param _inner, _outer: The blades grow where inner < |x| < outer */
+  GrassField(const Shader& _shader,
+             GLuint _num_slots = 2,
+             GLuint _num_blades = 32768,
+             GLfloat _length = 100.0f,
+             GLfloat _inner = 6.0f,
+             GLfloat _outer = 40.0f)
+      : shader(_shader),
+        num_blades(_num_blades),
+        length(_length),
+        inner(_inner),
+        outer(_outer),
+        segments(_num_slots),
+        lod_near(15.0f),
+        lod_far(80.0f),
+        lod_min_density(0.1f),
+        wind_direction(0.8f, 0.0f, -0.6f),
+        wind_strength(0.25f) {  // Do initialization
+    init();
+    for (GLuint i = 0; i < segments.size(); ++i)
+      setSegment(i, i);
+  }
+
+  /* Returns the private members
+  ** We set the grass field settings private, because they are not supposed to be
+  ** editted easily. If they need to be editted, call the `set*` functions, which makes
+  ** sure you edit them on purpose, instead of unconsciously. */
+  const GLint getSegment(const GLuint& slot) { return segments[slot].index; }
+  const GLuint getNumBlades() { return num_blades; }
+  const GLfloat getLength() { return length; }
+
+  /* Set some private members */
+  void setVisible(const GLuint& slot, GLboolean visible) { segments[slot].visible = visible; }
+  void setWind(const glm::vec3& direction, const GLfloat& strength) {
+    wind_direction = direction;
+    wind_strength = strength;
+  }
+
+  /* Set the distances of the density LOD
+  ** The density falls from 1 at @near to @min_density at @far. */
+  void setLOD(const GLfloat& near, const GLfloat& far, const GLfloat& min_density) {
+    lod_near = near;
+    lod_far = far;
+    lod_min_density = min_density;
+  }
+
+  /* Move a slot to the segment @index
+  ** The blades are generated on a worker thread, see `update` */
+  void setSegment(const GLuint& slot, const GLint& index) {
+    GrassSegment& segment = segments[slot];
+    if (segment.index == index) return;
+    segment.index = index;
+    segment.num_blades = 0;
+
+    GLfloat z_max = -length * index;
+    segment.box_min = glm::vec3(-outer, 0.0f, z_max - length);
+    segment.box_max = glm::vec3(outer, 2.0f, z_max);
+
+    // A generation still running is kept aside (destroying its future would block
+    // until it ends), its blades are dropped when they land (see `update`)
+    if (segment.pending.valid() && segment.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      discarded.push_back(std::move(segment.pending));
+    segment.pending = std::async(std::launch::async, generate,
+                                 index, num_blades, z_max, length, inner, outer);
+  }
+
+  /* UPDATE operations
+  ** Upload the segments whose blades are ready (GL calls stay on this thread) */
+  void update() {
+    for (GLuint i = 0; i < discarded.size();) {
+      if (discarded[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        discarded[i] = std::move(discarded.back());
+        discarded.pop_back();
+      } else {
+        ++i;
+      }
+    }
+
+    for (GLuint i = 0; i < segments.size(); ++i) {
+      GrassSegment& segment = segments[i];
+      if (!segment.pending.valid()) continue;
+      if (segment.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) continue;
+
+      std::vector<GrassBlade> blades = segment.pending.get();
+      glBindBuffer(GL_ARRAY_BUFFER, segment.VBO);
+      glBufferData(GL_ARRAY_BUFFER, blades.size() * sizeof(GrassBlade), blades.data(), GL_STATIC_DRAW);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      segment.num_blades = blades.size();
+    }
+  }
+
+  /* Function to draw the grass field, one draw call per visible segment
+  ** @param frustum: The view frustum, segments outside are skipped
+  ** The wind is driven by the time of the frame data. */
+  void draw(const Frustum& frustum) {
+    shader.install();
+    shader.setUniform3f("windDirection", wind_direction);
+    shader.setUniform1f("windStrength", wind_strength);
+    shader.setUniform3f("lod", glm::vec3(lod_near, lod_far, lod_min_density));
+
+    glState().bindVertexArray(VAO);
+    for (GLuint i = 0; i < segments.size(); ++i) {
+      GrassSegment& segment = segments[i];
+      if (!segment.visible || segment.num_blades == 0) continue;
+      if (!frustum.containsBox(segment.box_min, segment.box_max)) continue;
+      bindInstanceAttribs(segment.VBO);
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 7, segment.num_blades);
+    }
+  }
+
+ private:
+  /* PRIVATE MEMBER
+  ** Initiate the blade mesh and the buffers of all slots */
+  void init() {
+    // A tapered blade: (x across the blade, y along the blade)
+    GLfloat blade_strip[] =
+        {
+            -0.50f, 0.00f, 0.50f, 0.00f,
+            -0.40f, 0.33f, 0.40f, 0.33f,
+            -0.25f, 0.66f, 0.25f, 0.66f,
+            0.00f, 1.00f};
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO_blade);
+    glState().bindVertexArray(VAO);
+
+    // The data of VBO_blade is shared by every blade (instancing technique!)
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_blade);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(blade_strip), blade_strip, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
+
+    // Instance attributes, re-pointed at the buffer of each segment
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glState().bindVertexArray(0);
+
+    for (GLuint i = 0; i < segments.size(); ++i) {
+      glGenBuffers(1, &segments[i].VBO);
+      segments[i].index = -1;
+      segments[i].visible = true;
+      segments[i].num_blades = 0;
+    }
+  }
+
+  /* PRIVATE MEMBER
+  ** Point the instance attributes at a segment buffer (the VAO must be bound) */
+  void bindInstanceAttribs(const GLuint& buffer) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GrassBlade), (GLvoid*)offsetof(GrassBlade, position));
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(GrassBlade), (GLvoid*)offsetof(GrassBlade, height));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  /* PRIVATE MEMBER
+  ** Generate the blades of segment @index (runs on a worker thread, no GL calls!)
+  ** The blades grow in clumps, the seed only depends on @index. */
+  static std::vector<GrassBlade> generate(GLint index,
+                                          GLuint num,
+                                          GLfloat z_max,
+                                          GLfloat length,
+                                          GLfloat inner,
+                                          GLfloat outer) {
+    std::minstd_rand generator(0x9E3779B9u ^ (GLuint)(index * 2654435761u));
+    std::uniform_real_distribution<GLfloat> uniform(0.0f, 1.0f);
+    std::normal_distribution<GLfloat> scatter(0.0f, 1.2f);
+
+    const GLuint clump_size = 64;
+    std::vector<GrassBlade> blades(num);
+    GLfloat center_x = 0.0f, center_z = 0.0f;
+    for (GLuint i = 0; i < num; ++i) {
+      // Pick a new clump center (on either side of the path)
+      if (i % clump_size == 0) {
+        GLfloat side = uniform(generator) < 0.5f ? -1.0f : 1.0f;
+        center_x = side * (inner + (outer - inner) * uniform(generator));
+        center_z = z_max - length * uniform(generator);
+      }
+
+      GrassBlade& blade = blades[i];
+      GLfloat x = center_x + scatter(generator);
+      GLfloat z = center_z + scatter(generator);
+      // Keep the path clear and the segment closed
+      if (fabs(x) < inner) x = (x < 0.0f ? -inner : inner);
+      z = glm::clamp(z, z_max - length, z_max);
+
+      blade.position[0] = x;
+      blade.position[1] = 0.0f;
+      blade.position[2] = z;
+      blade.angle = 2.0f * M_PI * uniform(generator);
+      blade.height = 0.3f + 0.6f * uniform(generator);
+      blade.lod_rank = uniform(generator);
+      blade.phase = 2.0f * M_PI * uniform(generator);
+      blade.tint = 0.8f + 0.4f * uniform(generator);
+    }
+    return blades;
+  }
+
+  /* PRIVATE MEMBER
+  ** A specific shader for rendering grass */
+  Shader shader;
+
+  /* PRIVATE MEMBERS
+  ** @param num_blades: The number of blades in one segment
+  ** @param length: The length of one segment along z
+  ** @param inner, outer: The blades grow where inner < |x| < outer */
+  GLuint num_blades;
+  GLfloat length;
+  GLfloat inner, outer;
+
+  /* PRIVATE MEMBER
+  ** The segments alive (one per slot) */
+  std::vector<GrassSegment> segments;
+
+  /* PRIVATE MEMBER
+  ** The generations of the segments left before they were ready (see `setSegment`) */
+  std::vector<std::future<std::vector<GrassBlade> > > discarded;
+
+  /* PRIVATE MEMBERS
+  ** The distances of the density LOD and the least density (see `setLOD`) */
+  GLfloat lod_near, lod_far, lod_min_density;
+
+  /* PRIVATE MEMBERS
+  ** The direction and the strength of the wind */
+  glm::vec3 wind_direction;
+  GLfloat wind_strength;
+
+  /* PRIVATE MEMBERS
+  ** The VAO and the blade VBO of the grass field */
+  GLuint VAO, VBO_blade;
+};
+
+#endif
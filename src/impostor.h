@@ -0,0 +1,244 @@
+/*******************************************************************************
+** Software License Agreement (GNU GENERAL PUBLIC LICENSE)
+**
+** Copyright 2016-2017  Peiyu Liao (enzoliao95@gmail.com). All rights reserved.
+** Copyright 2016-2017  Yaohong Wu (wuyaohongdio@gmail.com). All rights reserved.
+**
+** LICENSE INFORMATION (GPL)
+** SEE `LICENSE` FILE.
+*******************************************************************************/
+
+#ifndef _IMPOSTOR_H_
+#define _IMPOSTOR_H_
+
+#include <GL/glew.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <vector>
+
+#include "frustum.h"
+#include "gl_state.h"
+#include "model.h"
+#include "shader.hpp"
+
+/* CLASS: Impostor
+** A model seen from far away, drawn as one camera-facing quad per placement.
+** At load time the model is rendered from @num_views directions around its up axis
+** into two atlases (the views side by side): the albedo, and the normal with the depth
+** (see `bake`). Every placement then picks the view nearest to the direction of the
+** camera and pushes its fragments back to the baked depth, so the quads meet the
+** ground and the meshes drawn near them right. All placements are one draw call. */
+class Impostor {
+ public:
+  /* Default constructor & Constructor
+  ** @param _bake_shader: Renders the model into the atlases (see impostor_bake.frag)
+  ** @param _shader: Draws the quads (see impostor.vert)
+  ** @param _albedo_unit, _normal_unit: The texture units the atlases are bound to
+  ** @param _num_views: The number of directions baked
+  ** @param _view_size: The width and height of one view in the atlases */
+  Impostor(const Shader& _bake_shader,
+           const Shader& _shader,
+           GLuint _albedo_unit,
+           GLuint _normal_unit,
+           GLuint _num_views = 8,
+           GLuint _view_size = 256)
+      : bake_shader(_bake_shader),
+        shader(_shader),
+        albedo_unit(_albedo_unit),
+        normal_unit(_normal_unit),
+        num_views(_num_views),
+        view_size(_view_size),
+        kd(1.0f),
+        num_instances(0),
+        instance_capacity(0) {  // Do initialization
+    init();
+  }
+
+  /* Returns the private members */
+  const GLuint getVAO() { return VAO; }
+  const GLuint getNumViews() { return num_views; }
+  const GLuint getNumInstances() { return num_instances; }
+
+  /* Render @model into the atlases
+  ** @param _orientation: Turns the model upright (its y axis up). All placements are
+  **     this orientation, turned around the y axis, scaled and moved (see `setInstances`) */
+  void bake(Model& model, const glm::mat4& _orientation) {
+    orientation = _orientation;
+    kd = model.getKd();
+
+    // The bounds of the upright model, each view is an orthographic camera around it
+    BoundingSphere upright = model.getBounds(orientation);
+    bounds = glm::vec4(upright.center, glm::max(upright.radius, 0.001f));
+
+    GLuint FBO, depth_buffer;
+    glGenFramebuffers(1, &FBO);
+    glGenRenderbuffers(1, &depth_buffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, num_views * view_size, view_size);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo_atlas, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal_atlas, 0);
+    GLenum buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, buffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      std::cout << "ERROR::IMPOSTOR:: Framebuffer is not complete!" << std::endl;
+
+    // Empty texels: no albedo (alpha 0), a normal facing the camera, the far depth
+    GLfloat no_albedo[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    GLfloat no_normal[] = {0.5f, 0.5f, 1.0f, 1.0f};
+    glClearBufferfv(GL_COLOR, 0, no_albedo);
+    glClearBufferfv(GL_COLOR, 1, no_normal);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glState().enable(GL_DEPTH_TEST);
+    glState().disable(GL_BLEND);
+
+    // The model is drawn upright at its full level of detail
+    glm::mat4 model_mat = model.getModelMatrix();
+    GLuint lod = model.getLod();
+    model.setModelMatrix(orientation);
+    model.setLod(0);
+
+    // The view i looks at the model from the azimuth `2 * pi * i / num_views`
+    // Its depth is linear (orthographic) from `radius` to `3 * radius` away
+    glm::vec3 center(bounds);
+    GLfloat radius = bounds.w;
+    glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, 3.0f * radius);
+    bake_shader.install();
+    for (GLuint i = 0; i < num_views; ++i) {
+      GLfloat azimuth = 2.0f * (GLfloat)M_PI * i / num_views;
+      glm::vec3 eye = center + 2.0f * radius * glm::vec3(sin(azimuth), 0.0f, cos(azimuth));
+      glViewport(i * view_size, 0, view_size, view_size);
+      bake_shader.setUniformMatrix4fv("viewProj", projection * glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f)));
+      model.draw(bake_shader);
+    }
+
+    model.setModelMatrix(model_mat);
+    model.setLod(lod);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteRenderbuffers(1, &depth_buffer);
+    glDeleteFramebuffers(1, &FBO);
+
+    // The far placements read the smaller levels
+    GLuint atlases[] = {albedo_atlas, normal_atlas};
+    GLuint units[] = {albedo_unit, normal_unit};
+    for (GLuint i = 0; i < 2; ++i) {
+      glState().bindTexture(units[i], atlases[i]);
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
+  }
+
+  /* Upload the placements drawn by `draw`
+  ** @param model_mats: The model matrices of the placements (as for `Model::setInstances`) */
+  void setInstances(const std::vector<glm::mat4>& model_mats) {
+    // The quads are built in the upright space of the model (see `bake`)
+    glm::mat4 upright_to_model = glm::inverse(orientation);
+    std::vector<glm::mat4> placements(model_mats.size());
+    for (GLuint i = 0; i < model_mats.size(); ++i)
+      placements[i] = model_mats[i] * upright_to_model;
+
+    num_instances = placements.size();
+    glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+    if (num_instances > instance_capacity) {
+      instance_capacity = num_instances;
+      glBufferData(GL_ARRAY_BUFFER, instance_capacity * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+    }
+    if (num_instances > 0)
+      glBufferSubData(GL_ARRAY_BUFFER, 0, num_instances * sizeof(glm::mat4), &placements[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  /* DRAW all placements (one instanced draw call) */
+  void draw() {
+    if (num_instances == 0) return;
+    shader.install();
+    glState().bindTexture(albedo_unit, albedo_atlas);
+    glState().bindTexture(normal_unit, normal_atlas);
+    shader.setUniform1i("albedoAtlas", albedo_unit);
+    shader.setUniform1i("normalAtlas", normal_unit);
+    shader.setUniform1i("numViews", num_views);
+    shader.setUniform4f("bounds", bounds);
+    shader.setUniform1f("kd", kd);
+
+    glState().bindVertexArray(VAO);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, num_instances);
+  }
+
+ private:
+  /* PRIVATE MEMBER:
+  ** Do Initialization */
+  void init() {
+    orientation = glm::mat4();
+    bounds = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+    // The atlases: albedo (RGBA), normal (RGB) and depth (A)
+    // Each is bound on its own unit, the textures bound on the other units stay
+    GLuint* atlases[] = {&albedo_atlas, &normal_atlas};
+    GLuint units[] = {albedo_unit, normal_unit};
+    for (GLuint i = 0; i < 2; ++i) {
+      glGenTextures(1, atlases[i]);
+      glState().bindTexture(units[i], *atlases[i]);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, num_views * view_size, view_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    // The quad (its corners in [-1, 1]) and the placements (a mat4 takes 4 locations,
+    // 5 ~ 8, as `instanceModel` of main.vert)
+    GLfloat quad[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &quad_VBO);
+    glGenBuffers(1, &instance_VBO);
+    glState().bindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, quad_VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+    for (GLuint i = 0; i < 4; ++i) {
+      glEnableVertexAttribArray(5 + i);
+      glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(i * sizeof(glm::vec4)));
+      glVertexAttribDivisor(5 + i, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glState().bindVertexArray(0);
+  }
+
+  /* PRIVATE MEMBERS
+  ** @param bake_shader: Renders the model into the atlases
+  ** @param shader: Draws the quads */
+  Shader bake_shader, shader;
+
+  /* PRIVATE MEMBERS
+  ** The texture units the atlases are bound to */
+  GLuint albedo_unit, normal_unit;
+
+  /* PRIVATE MEMBERS
+  ** @param num_views: The number of directions baked
+  ** @param view_size: The width and height of one view in the atlases */
+  GLuint num_views, view_size;
+
+  /* PRIVATE MEMBERS: The baked model
+  ** @param orientation: Turns the model upright
+  ** @param bounds: The bounding sphere of the upright model (center, radius)
+  ** @param kd: The diffuse coefficient of the model */
+  glm::mat4 orientation;
+  glm::vec4 bounds;
+  GLfloat kd;
+
+  /* PRIVATE MEMBERS
+  ** The atlases of the views (side by side) */
+  GLuint albedo_atlas, normal_atlas;
+
+  /* PRIVATE MEMBERS
+  ** The VAO, the quad and the placements */
+  GLuint VAO, quad_VBO, instance_VBO;
+  GLuint num_instances, instance_capacity;
+};
+
+#endif
@@ -14,7 +14,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include "shader.hpp"
+#include "uniform_blocks.h"
 
 class Light {
  public:
@@ -44,14 +44,12 @@ class Light {
   void setDiffuse(const glm::vec3& _diffuse) { diffuse = _diffuse; }
   void setSpecular(const glm::vec3& _specular) { specular = _specular; }
 
-  /* Function binds light shader */
-  void bindShader(Shader shader) {
-    shader.install();
-    shader.setUniform3fv("light.direction", direction);
-    shader.setUniform3fv("light.ambient", ambient);
-    shader.setUniform3fv("light.diffuse", diffuse);
-    shader.setUniform3fv("light.specular", specular);
-    shader.uninstall();
+  /* Function writes the light settings into the frame data */
+  void bindFrameData(FrameData& frame) {
+    frame.lightDirection = direction;
+    frame.lightAmbient = ambient;
+    frame.lightDiffuse = diffuse;
+    frame.lightSpecular = specular;
   }
 
  private:
@@ -14,15 +14,25 @@
 
 #include "billboard.h"
 #include "camera.h"
+#include "frustum.h"
+#include "gl_state.h"
+#include "grass_field.h"
 #include "hmap_generator.h"
+#include "impostor.h"
 #include "model.h"
 #include "particle_system.h"
+#include "render_queue.h"
 #include "shader.hpp"
 #include "shadow_map.h"
+#include "snow_map.h"
 #include "texture.h"
 #include "util.h"
 
 #define FULL_SCREEN_MODE
+// Print the GL calls issued / skipped by the state tracker every frame
+// #define GL_STATE_STATS
+// Print the objects drawn / culled by the frusta in each pass every frame
+// #define CULL_STATS
 
 #ifdef _WIN32
 #pragma comment(lib, "opengl32.lib")
@@ -37,6 +47,19 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void move_func();
+GLfloat groundHeight(const GLfloat& x, const GLfloat& z);
+void updatePlantInstances();
+void updateLods(const glm::vec3& eye, const GLfloat& proj_scale);
+void endFrame();
+void submitObject(Shader& shader, Object& object, const glm::vec3& position);
+void submitTerrain(Shader& shader, const glm::mat4& model);
+void submitPath(Shader& shader, const glm::mat4& model, Texture* texture);
+void renderShadowMap();
+void selectMainShader();
+ShaderDefines mainShaderDefines(const GLboolean& snow);
+void beginCascade(const GLuint& cascade);
+GLboolean isVisible(Shader& shader, const BoundingSphere& bounds);
+void updateShadowCascades(FrameData& frame, const glm::mat4& view);
 
 /* Function to do screen shot */
 void screenshot() {
@@ -114,6 +137,7 @@ void initGL() {
   // GLEW initiation is really important
   glewExperimental = GL_TRUE;
   glewInit();
+  Shader::enableParallelCompile();
 
   // Ensure we can capture the escape key being pressed below
   glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
@@ -123,7 +147,7 @@ void initGL() {
   glfwSetScrollCallback(window, scroll_callback);
   glViewport(0, 0, window_width, window_height);
 
-  glEnable(GL_DEPTH_TEST);
+  glState().enable(GL_DEPTH_TEST);
   glDepthFunc(GL_LESS);
 }
 
@@ -154,23 +178,37 @@ void initScene() {
   texture_sbb.setUnit(10);
 
   // Load Shaders
-  main_shader.reload("../assets/shaders/main.vert", "../assets/shaders/main.frag");
-  main_shader.setFuncType(NORMAL);
-  depth_shader.reload("../assets/shaders/shadow_mapping_depth.vert", "../assets/shaders/shadow_mapping_depth.frag");
+  // All shaders are submitted first and checked when first installed, so the driver
+  // compiles them together (see `Shader::submit`). The ones the intro does not use
+  // are finished in the background (see `Shader::finishReady` in `main`).
+  // The main shader variant is selected by stage (see `selectMainShader`), the depth
+  // shader is its position-only variant. The game over and win billboards share one
+  // variant (their size is set when drawing).
+  Shader::variant(main_vert_path, main_frag_path, mainShaderDefines(false));
+  Shader::variant(main_vert_path, main_frag_path, mainShaderDefines(true));
+  depth_shader = Shader::variant(main_vert_path, "../assets/shaders/shadow_mapping_depth.frag", {"DEPTH_ONLY"});
   depth_shader.setFuncType(DEPTH);
-  particle_shader.reload("../assets/shaders/particle_system.vert", "../assets/shaders/particle_system.frag");
+  particle_shader.submit("../assets/shaders/particle_system.vert", "../assets/shaders/particle_system.frag");
   particle_shader.setFuncType(PARTICLE);
-  billboard_shader.reload("../assets/shaders/billboard.vert", "../assets/shaders/billboard.frag");
+  billboard_shader = Shader::variant("../assets/shaders/billboard.vert", "../assets/shaders/billboard.frag", {"LIFE_BAR"});
   billboard_shader.setFuncType(BILLBOARD);
-  go_shader.reload("../assets/shaders/start_over.vert", "../assets/shaders/start_over.frag");
+  go_shader = Shader::variant("../assets/shaders/billboard.vert", "../assets/shaders/billboard.frag", {"CENTERED"});
   go_shader.setFuncType(BILLBOARD);
-  win_shader.reload("../assets/shaders/start_over.vert", "../assets/shaders/start_over.frag");
-  win_shader.setFuncType(BILLBOARD);
+  win_shader = go_shader;
+  snow_splat_shader.submit("../assets/shaders/snow_splat.vert", "../assets/shaders/snow_splat.frag");
+  snow_splat_shader.setFuncType(SNOW);
+  snow_scroll_shader.submit("../assets/shaders/snow_scroll.vert", "../assets/shaders/snow_scroll.frag");
+  snow_scroll_shader.setFuncType(SNOW);
+  grass_shader.submit("../assets/shaders/grass.vert", "../assets/shaders/grass.frag");
+  grass_shader.setFuncType(GRASS);
+  impostor_bake_shader.submit("../assets/shaders/impostor_bake.vert", "../assets/shaders/impostor_bake.frag");
+  impostor_bake_shader.setFuncType(IMPOSTOR);
+  impostor_shader.submit("../assets/shaders/impostor.vert", "../assets/shaders/impostor.frag");
+  impostor_shader.setFuncType(IMPOSTOR);
 
   // Set light
   lightDir = light0.getDirection();
   lightPos = snowball.getCurPosition() + glm::vec3(0.0f, 4.0f, 15.0f) - 20.0f * lightDir;
-  light0.bindShader(main_shader);
 
   // Setup objects
   mini_terrain.setup();
@@ -181,46 +219,27 @@ void initScene() {
   barrier_cube.setup();
 
   // Load models
-  grass.load_from_files("../assets/models/grass/grass.obj", "../assets/models/grass/grass.png");
   tree.load_from_file("../assets/models/tree/tree.3ds");
   snowhouse.load_from_file("../assets/models/snow_house/SnowCoveredCottageOBJ.obj");
 
   // Initialize particle system, shadow map and others
-  ps = new ParticleSystem(particle_shader, texture_snowflake, glm::vec3(0, 30.0f, -2050), 1000, 50, 50);
-  sm = new ShadowMap(shadow_map_width, shadow_map_height);
+  ps = new ParticleSystem(particle_shader, 16384);
+  sm = new ShadowMap(shadow_cascade_size, NUM_SHADOW_CASCADES);
+  snow_map = new SnowMap(snow_splat_shader, snow_scroll_shader, snow_map_unit);
+  grass_field = new GrassField(grass_shader);
   billboard = new Billboard(billboard_shader, texture_billboard);
+  billboard->setSize(0.6f, 0.075f);
   gameover = new Billboard(go_shader, texture_gameover);
   winning = new Billboard(win_shader, texture_win);
 
-  // Bind shadow map
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, sm->getDepthMap());
-  main_shader.install();
-  main_shader.setUniform1i("shadowMap", 0);
-  main_shader.uninstall();
-
-  // Bind snow map
+  // Bind shadow map and snow map (the samplers are set by `selectMainShader`)
+  glState().bindTexture(0, sm->getDepthMap());
   texture_white.bind(texture_white.getUnit());
-  main_shader.install();
-  main_shader.setUniform1i("snowMap", texture_white.getUnit());
-  main_shader.uninstall();
+  selectMainShader();
 
   // Initialize transformation matrices for objects
   glm::mat4 trans = glm::translate(glm::mat4(), glm::vec3(0, 0, -100));
   {
-    grassModelMatsA.reserve(num_grass);
-    grassModelMatsB.reserve(num_grass);
-    for (GLuint i = 0; i < num_grass / 2; i++) {
-      int temp = -10 * i;
-      glm::mat4 model;
-      model = glm::translate(glm::mat4(), glm::vec3(-7, 0, temp));
-      grassModelMatsA.push_back(model);
-      grassModelMatsB.push_back(trans * model);
-      model = glm::translate(glm::mat4(), glm::vec3(7, 0, temp));
-      grassModelMatsA.push_back(model);
-      grassModelMatsB.push_back(trans * model);
-    }
-
     treeModelMatsA.reserve(num_tree);
     treeModelMatsB.reserve(num_tree);
     for (GLuint i = 0; i < num_tree / 2; i++) {
@@ -246,6 +265,13 @@ void initScene() {
       treeModelMatsB.push_back(trans * model);
     }
   }
+  // Bake the impostor of the trees, upright as they are placed (see `Impostor::bake`)
+  {
+    glm::mat4 orientation = treeModelMatsA[0];
+    orientation[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    tree_impostor = new Impostor(impostor_bake_shader, impostor_shader, impostor_albedo_unit, impostor_normal_unit);
+    tree_impostor->bake(tree, orientation);
+  }
   // path
   {
     glm::mat4 model;
@@ -283,6 +309,8 @@ void initScene() {
     model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
     snowhouse.setModelMatrix(model);
   }
+  // Upload the placements of trees for instanced drawing
+  updatePlantInstances();
   // barrier cube
   {
     glm::mat4 temp = glm::scale(glm::mat4(), glm::vec3(2, 2, 2));
@@ -301,6 +329,122 @@ void initScene() {
   barriers.setNumBarTypes(2);
   barriers.setBarrierObj(0, barrier_ball);
   barriers.setBarrierObj(1, barrier_cube);
+
+  // Initialize particle emitters
+  // Falling snow is drawn additively, powder and bursts are alpha blended
+  {
+    GLuint snow_group = ps->addGroup(texture_snowflake, GL_ONE);
+    GLuint powder_group = ps->addGroup(texture_snowflake, GL_ONE_MINUS_SRC_ALPHA);
+
+    ParticleEmitter snow(snow_group, glm::vec3(0, 30.0f, -2050), 1000, 8.0f,
+                         glm::vec3(-50, -10, -50), glm::vec3(50, 0, 50));
+    snow.active = false;
+    snow.follow = true;
+    snow_emitter = ps->addEmitter(snow);
+
+    ParticleEmitter powder(powder_group, snowball.getCurPosition(), 150, 0.6f,
+                           glm::vec3(-0.3f, 0.0f, -0.3f), glm::vec3(0.3f, 0.2f, 0.3f),
+                           glm::vec3(-1.5f, 1.0f, 0.5f), glm::vec3(1.5f, 3.0f, 3.0f),
+                           100.0f, 0.12f);
+    powder.active = false;
+    powder_emitter = ps->addEmitter(powder);
+
+    ParticleEmitter impact(powder_group, glm::vec3(0.0f), 0, 1.0f,
+                           glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3(0.5f, 0.5f, 0.5f),
+                           glm::vec3(-4.0f, 1.0f, -4.0f), glm::vec3(4.0f, 6.0f, 4.0f),
+                           100.0f, 0.15f);
+    impact_emitter = ps->addEmitter(impact);
+
+    // Snowflakes live until they land (on the path or on the terrains)
+    ps->setGround(groundHeight, true);
+  }
+}
+
+/* Fit the shadow cascades to the camera frustum
+** The view distance is split between the cascades (a blend of the logarithmic and the
+** uniform splits). Each cascade is an orthographic light frustum around the bounding
+** sphere of its slice of the camera frustum. The sphere does not change when the
+** camera turns, and its center is snapped (across the light) to steps of
+** `shadow_snap_texels` texels in the light view space: the shadows do not swim and the
+** cached static casters stay valid until the next step (see `renderShadowMap`). The
+** frustum is one step wider than the sphere, so the snapped one still holds it. */
+void updateShadowCascades(FrameData& frame, const glm::mat4& view) {
+  const GLfloat near_plane = 0.1f, lambda = 0.75f;
+  // The light frustum is pulled back, so the casters between the light and a slice
+  // are drawn too
+  const GLfloat pull_back = 50.0f;
+
+  GLfloat aspect = (float)window_width / (float)window_height;
+  glm::vec3 direction = glm::normalize(light0.getDirection());
+  glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, glm::vec3(0.0, 1.0, 0.0));
+  glm::mat4 inverseView = glm::inverse(view);
+
+  GLfloat split_near = near_plane;
+  for (GLuint i = 0; i < NUM_SHADOW_CASCADES; ++i) {
+    GLfloat ratio = (GLfloat)(i + 1) / NUM_SHADOW_CASCADES;
+    GLfloat split_far = lambda * near_plane * pow(shadow_distance / near_plane, ratio) +
+                        (1.0f - lambda) * (near_plane + (shadow_distance - near_plane) * ratio);
+    frame.cascadeSplits[i] = split_far;
+
+    // The bounding sphere of the slice (world space)
+    glm::mat4 inverseSlice = inverseView * glm::inverse(glm::perspective(camera.getFovy(), aspect, split_near, split_far));
+    glm::vec3 corners[8];
+    glm::vec3 center(0.0f);
+    for (GLuint c = 0; c < 8; ++c) {
+      glm::vec4 corner = inverseSlice * glm::vec4(c & 1 ? 1.0f : -1.0f, c & 2 ? 1.0f : -1.0f, c & 4 ? 1.0f : -1.0f, 1.0f);
+      corners[c] = glm::vec3(corner) / corner.w;
+      center += corners[c] / 8.0f;
+    }
+    GLfloat radius = 0.0f;
+    for (GLuint c = 0; c < 8; ++c)
+      radius = glm::max(radius, glm::length(corners[c] - center));
+    radius = ceil(radius);  // Keep the texel size stable
+
+    // The half extent of the frustum is padded by one snap step, which is measured in
+    // texels of the padded frustum: `extent - radius == snap`
+    GLfloat snap_ratio = 2.0f * shadow_snap_texels / shadow_cascade_size;
+    GLfloat extent = radius / (1.0f - snap_ratio);
+    GLfloat snap = snap_ratio * extent;
+
+    // Snap the center across the light (x and y of the light view space), its depth
+    // stays so the slice lies between the near and the far plane
+    glm::vec3 centerLight = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+    centerLight.x = floor(centerLight.x / snap + 0.5f) * snap;
+    centerLight.y = floor(centerLight.y / snap + 0.5f) * snap;
+    center = glm::vec3(glm::inverse(lightRotation) * glm::vec4(centerLight, 1.0f));
+
+    lightPos = center - (radius + pull_back) * direction;
+    glm::mat4 lightProjection = glm::ortho(-extent, extent, -extent, extent, 0.0f, 2.0f * radius + pull_back);
+    glm::mat4 lightView = glm::lookAt(lightPos, center, glm::vec3(0.0, 1.0, 0.0));
+    lightSpaces[i] = lightProjection * lightView;
+    frame.lightSpace[i] = lightSpaces[i];
+    cascadeSpheres[i] = glm::vec4(center, extent);
+    split_near = split_far;
+  }
+  frame.cascadeSplits.w = shadow_distance;
+}
+
+/* The features of the main shader variant, with or without the snow blending */
+ShaderDefines mainShaderDefines(const GLboolean& snow) {
+  ShaderDefines defines = {"SHADOWS", "PCF_KERNEL 2"};
+  if (snow) defines.push_back("SNOW_BLEND");
+  return defines;
+}
+
+/* Select the variant of the main shader for the current stage
+** Before the snow starts (`factor` is zero) no fragment samples the snow maps. A
+** variant gets its samplers and the snow factor when it is selected. */
+void selectMainShader() {
+  Shader shader = Shader::variant(main_vert_path, main_frag_path, mainShaderDefines(drawSnow && factor > 0.0f));
+  if (shader.getProgram() == main_shader.getProgram()) return;
+  main_shader = shader;
+  main_shader.setFuncType(NORMAL);
+  main_shader.install();
+  main_shader.setUniform1i("shadowMap", 0);
+  main_shader.setUniform1i("snowMap", texture_white.getUnit());
+  main_shader.setUniform1i("snowAccumMap", snow_map->getUnit());
+  main_shader.setUniform1f("factor", factor);
+  main_shader.uninstall();
 }
 
 /* update camera settings, light settings, objects settings, etc. */
@@ -311,6 +455,7 @@ void updateScene() {
     pathTexA = &texture_mud;
     drawPlantA = false;
     drawTerrainA = true;
+    updatePlantInstances();
   }
   if (dist_total > 1000 && stageB == 1)  // change scene B
   {
@@ -318,6 +463,7 @@ void updateScene() {
     pathTexB = &texture_mud;
     drawPlantB = false;
     drawTerrainB = true;
+    updatePlantInstances();
   }
   if (dist_total > 1900 && stageA == 2) {
     stageA++;
@@ -329,12 +475,15 @@ void updateScene() {
   }
   if (dist_total > 2500 && drawTerrainA == true) {
     drawTerrainA = false;
+    sm->invalidate();
   }
   if (dist_total > 2600 && drawTerrainB == true) {
     drawTerrainB = false;
+    sm->invalidate();
   }
-  if (dist_total > 2700) {
+  if (dist_total > 2700 && drawSnowHouse == false) {
     drawSnowHouse = true;
+    sm->invalidate();
   }
 
   // Get the current position of the snow ball
@@ -358,54 +507,65 @@ void updateScene() {
   if (lightDir.x > 1) lightDir.x -= 0.05 * deltaTime;
   if (lightDir.x < -1) lightDir.x += 0.05 * deltaTime;
   light0.setDirection(lightDir);
-  light0.bindShader(main_shader);
-
-  // Re-compute the light position vector
-  lightPos = snowball.getCurPosition() + glm::vec3(0.0f, 4.0f, 15.0f) - 20.0f * light0.getDirection();
-  glm::mat4 lightProjection, lightView, lightSpaceMatrix;
-  lightProjection = glm::ortho(-50.0f, 50.0f, -50.0f, 50.0f, 1.0f, 100.0f);
-  lightView = glm::lookAt(lightPos,
-                          snowball.getCurPosition() + glm::vec3(0.0f, 4.0f, 15.0f),
-                          glm::vec3(0.0, 1.0, 0.0));
-  lightSpaceMatrix = lightProjection * lightView;
-
-  // Set uniforms for our shaders
-  main_shader.install();
-  main_shader.setUniformMatrix4fv("projection", projection);
-  main_shader.setUniformMatrix4fv("view", view);
-  main_shader.setUniform3f("viewPos", camera.getPosition());
-  main_shader.setUniformMatrix4fv("lightSpaceMatrix", lightSpaceMatrix);
-  depth_shader.install();
-  depth_shader.setUniformMatrix4fv("lightSpaceMatrix", lightSpaceMatrix);
-  particle_shader.install();
-  particle_shader.setUniformMatrix4fv("projection", projection);
-  particle_shader.setUniformMatrix4fv("view", view);
-  particle_shader.uninstall();
 
-  // Update particle system
-  if (drawSnow) {
+  // Upload the camera, light and shadow data shared by all shaders (one buffer update)
+  FrameData frame;
+  frame.view = view;
+  frame.projection = projection;
+  frame.viewProj = projection * view;
+  updateShadowCascades(frame, view);
+  frame.viewPos = camera.getPosition();
+  frame.time = glfwGetTime();
+  light0.bindFrameData(frame);
+  frameDataBuffer().update(frame);
+  camera_frustum.update(frame.viewProj);
+  updateLods(camera.getPosition(), projection[1][1]);
+
+  // Upload the grass segments generated since the last frame
+  grass_field->update();
+
+  // Update particle emitters and the shared particle pool
+  {
+    ParticleEmitter& snow = ps->getEmitter(snow_emitter);
+    snow.active = drawSnow;
     if (startMovePS)
-      ps->setGeneratorPos(glm::vec3(0, 30, currentZ));
+      snow.position = glm::vec3(0, 30, currentZ);
+
+    // Powder sprays from the snowball once it rolls on snow
+    ParticleEmitter& powder = ps->getEmitter(powder_emitter);
+    powder.active = drawSnow && bTemp && game_process_flag;
+    powder.position = glm::vec3(currentX, 0.0f, currentZ + 0.5f * snowball.getRadius());
+
+    ps->setOrigin(snowball.getCurPosition());
+    ps->setView(camera_frustum, camera.getPosition());
     ps->update(deltaTime);
+  }
 
+  if (drawSnow) {
     if (factor < 0.9f) {  // For changing texture
       factor += 0.05 * deltaTime;
+      selectMainShader();
       main_shader.install();
       main_shader.setUniform1f("factor", factor);
       main_shader.uninstall();
     }
   }
 
+  // Splat the impacts into the snow accumulation map and bind it for the main shader
+  snow_map->update(ps->getImpacts(), snowball.getCurPosition(), deltaTime);
+  main_shader.install();
+  main_shader.setUniform4f("snowRegion", snow_map->getRegion());
+  main_shader.uninstall();
+
   // Update our scene when dist_delta > 100
   if (dist_delta > 100) {
     glm::mat4 temp = glm::translate(glm::mat4(), glm::vec3(0, 0, -200));
     if (updateA)  // update Scene A
     {
       if (drawPlantA) {
-        for (GLuint i = 0; i < num_grass; ++i)
-          grassModelMatsA[i] = temp * grassModelMatsA[i];
         for (GLuint i = 0; i < num_tree; ++i)
           treeModelMatsA[i] = temp * treeModelMatsA[i];
+        grass_field->setSegment(0, grass_field->getSegment(0) + 2);
       }
       if (drawTerrainA) {
         for (GLuint i = 0; i < num_terrain; ++i)
@@ -417,10 +577,9 @@ void updateScene() {
     } else  // update Scene B
     {
       if (drawPlantB) {
-        for (GLuint i = 0; i < num_grass; ++i)
-          grassModelMatsB[i] = temp * grassModelMatsB[i];
         for (GLuint i = 0; i < num_tree; ++i)
           treeModelMatsB[i] = temp * treeModelMatsB[i];
+        grass_field->setSegment(1, grass_field->getSegment(1) + 2);
       }
       if (drawTerrainB) {
         for (GLuint i = 0; i < num_terrain; ++i)
@@ -430,6 +589,7 @@ void updateScene() {
       pathModelMatB = temp * pathModelMatB;
       updateA = !updateA;
     }
+    updatePlantInstances();
     dist_delta -= 100;
   }
 
@@ -528,6 +688,8 @@ void updateScene() {
       // eat this food
       if (abs(currentX - foodPositionX[0]) < 1.0f) {
         snowball.setRadius(snowball.getRadius() + 0.01);
+        ps->getEmitter(impact_emitter).position = glm::vec3(foodPositionX[0], barriers.getBaseline(), barrierPositionZ);
+        ps->burst(impact_emitter, 80);
       } else if (currentX < safePositionX - 1.2f ||
                  currentX > safePositionX + 1.2f ||
                  snowball.getRadius() < 0.05f) {
@@ -541,6 +703,9 @@ void updateScene() {
       if (currentX < safePositionX - 1.2f ||
           currentX > safePositionX + 1.2f) {
         snowball.setRadius(snowball.getRadius() + 0.01);
+        GLfloat foodX = (currentX < safePositionX) ? foodPositionX[0] : foodPositionX[1];
+        ps->getEmitter(impact_emitter).position = glm::vec3(foodX, barriers.getBaseline(), barrierPositionZ);
+        ps->burst(impact_emitter, 80);
       }
     }
 
@@ -559,118 +724,262 @@ void updateScene() {
   // Increase rotation angle
   barriers.setRotSpeed(rotSpeed + 0.01f);
 
-  // Update billboard(life)
-  float LifeLevel = snowball.getRadius();
-  billboard_shader.install();
-  billboard_shader.setUniform1f("LifeLevel", LifeLevel);
-  billboard_shader.setUniform1f("billboardLen", 0.6f);
-  billboard_shader.setUniform1f("billboardWidth", 0.075f);
-  billboard_shader.uninstall();
-
-  go_shader.install();
-  go_shader.setUniform1f("billboardLen", 0.001f * gameover->getWidth());
-  go_shader.setUniform1f("billboardWidth", 0.001f * gameover->getHeight());
-  go_shader.uninstall();
-
-  win_shader.install();
-  win_shader.setUniform1f("billboardLen", 0.001f * winning->getWidth());
-  win_shader.setUniform1f("billboardWidth", 0.001f * winning->getHeight());
-  win_shader.uninstall();
+  // Only the rows around the snowball are drawn (both passes see less than 120 units)
+  barriers.setView(currentZ, 120.0f);
+
+  // The billboards set their size and life level when drawn (see `renderScene`)
 }
 
 // Note that renderScene() will be called for every iteration!
 // One for depth buffer(shadow map), one for color buffer(display screen)
 // So do not update any parameters in this function!
-void renderScene(Shader shader) {
+// @casters: The shadow casters drawn in the depth pass (see `renderShadowMap`)
+void renderScene(Shader shader, const CasterSet& casters = CASTERS_ALL) {
   glm::mat4 model;
-
-  // render scene A
-  {
-    if (drawPlantA) {
-      for (GLuint i = 0; i < num_grass; ++i) {
-        grass.setModelMatrix(grassModelMatsA[i]);
-        grass.draw(shader);
-      }
-
-      for (GLuint i = 0; i < num_tree; ++i) {
-        tree.setModelMatrix(treeModelMatsA[i]);
-        tree.draw(shader);
+  GLuint program = shader.getProgram();
+  GLboolean depth_pass = (shader.getFuncType() == DEPTH);
+  GLboolean draw_static = !depth_pass || casters != CASTERS_DYNAMIC;
+  GLboolean draw_dynamic = !depth_pass || casters != CASTERS_STATIC;
+
+  // The default states of the scene, blended draws set their own (and keep them)
+  glState().enable(GL_DEPTH_TEST);
+  glState().disable(GL_BLEND);
+
+  // Collect the draws of the pass, they are sorted by `render_queue.execute()`
+  // The depth is measured from the camera (100 is the far plane, see `updateScene`)
+  render_queue.clear();
+  render_queue.setView(camera.getPosition(), 100.0f);
+
+  // The depth pass draws the shadow casters through their depth-only path: positions
+  // only, no textures and no material (see `Object::drawDepth`)
+
+  // The static casters: trees, grass, terrains, path and the snow house
+  if (draw_static) {
+    // render trees of both scenes (one draw call per mesh)
+    // Only the trees inside the frustum of the pass are uploaded to the instance buffer,
+    // with their levels of detail (see `updateLods`). The far trees are impostors in
+    // the main pass (one draw call), the shadow pass keeps their meshes.
+    // The trees span the whole scene, so they get the nearest depth (drawn first)
+    std::vector<glm::mat4> visible_trees, impostor_trees;
+    std::vector<GLuint> visible_lods;
+    for (GLuint i = 0; i < tree_instances.size(); ++i) {
+      if (!isVisible(shader, tree.getBounds(tree_instances[i]))) continue;
+      if (!depth_pass && tree_impostors[i]) {
+        impostor_trees.push_back(tree_instances[i]);
+        continue;
       }
+      visible_trees.push_back(tree_instances[i]);
+      visible_lods.push_back(tree_lods[i]);
     }
-    if (drawTerrainA) {
-      for (GLuint i = 0; i < num_terrain; ++i) {
-        mini_terrain.setModelMatrix(terrainModelMatsA[i]);
-        mini_terrain.draw(shader);
-      }
+    tree.setInstances(visible_trees, visible_lods);
+    if (!impostor_trees.empty()) {
+      tree_impostor->setInstances(impostor_trees);
+      render_queue.submit(PASS_OPAQUE, impostor_shader.getProgram(), 0, tree_impostor->getVAO(),
+                          camera.getPosition(), []() { tree_impostor->draw(); });
+    }
+    if (visible_trees.empty()) {
+      // Nothing to draw
+    } else if (depth_pass) {
+      render_queue.submit(PASS_OPAQUE, program, 0, tree.meshes.empty() ? 0 : tree.meshes[0].depthVAO,
+                          camera.getPosition(), [&shader]() { tree.drawDepthInstanced(shader); });
+    } else {
+      render_queue.submit(PASS_OPAQUE, program, 0, tree.meshes.empty() ? 0 : tree.meshes[0].VAO,
+                          camera.getPosition(), [&shader]() { tree.drawInstanced(shader); });
     }
 
-    path.setModelMatrix(pathModelMatA);
-    path.setTexture(pathTexA);
-    path.draw(shader);
-  }
-
-  // render scene B
-  {
-    if (drawPlantB) {
-      for (GLuint i = 0; i < num_grass; ++i) {
-        grass.setModelMatrix(grassModelMatsB[i]);
-        grass.draw(shader);
-      }
+    // render the grass field (one draw call per segment)
+    // The blades are too thin to cast useful shadows, so skip them in the depth pass
+    if (!depth_pass) {
+      render_queue.submit(PASS_OPAQUE, grass_shader.getProgram(), 0, 0, camera.getPosition(),
+                          []() { grass_field->draw(camera_frustum); });
+    }
 
-      for (GLuint i = 0; i < num_tree; ++i) {
-        tree.setModelMatrix(treeModelMatsB[i]);
-        tree.draw(shader);
-      }
+    // render scene A and scene B
+    for (GLuint i = 0; i < num_terrain; ++i) {
+      if (drawTerrainA) submitTerrain(shader, terrainModelMatsA[i]);
+      if (drawTerrainB) submitTerrain(shader, terrainModelMatsB[i]);
     }
-    if (drawTerrainB) {
-      for (GLuint i = 0; i < num_terrain; ++i) {
-        mini_terrain.setModelMatrix(terrainModelMatsB[i]);
-        mini_terrain.draw(shader);
-      }
+    submitPath(shader, pathModelMatA, pathTexA);
+    submitPath(shader, pathModelMatB, pathTexB);
+
+    GLboolean draw_house = drawSnowHouse && isVisible(shader, snowhouse.getBounds(snowhouse.getModelMatrix()));
+    if (draw_house && depth_pass) {
+      render_queue.submit(PASS_OPAQUE, program, 0, snowhouse.meshes.empty() ? 0 : snowhouse.meshes[0].depthVAO,
+                          glm::vec3(snowhouse.getModelMatrix()[3]), [&shader]() { snowhouse.drawDepth(shader); });
+    } else if (draw_house) {
+      render_queue.submit(PASS_OPAQUE, program, 0, snowhouse.meshes.empty() ? 0 : snowhouse.meshes[0].VAO,
+                          glm::vec3(snowhouse.getModelMatrix()[3]), [&shader]() { snowhouse.draw(shader); });
     }
-
-    path.setModelMatrix(pathModelMatB);
-    path.setTexture(pathTexB);
-    path.draw(shader);
   }
 
-  if (drawSnowHouse) {
-    snowhouse.draw(shader);
-  }
-
-  // Draw snowball
-  GLfloat radius = snowball.getRadius();
-  model = glm::translate(glm::mat4(), glm::vec3(currentX, currentY, currentZ));
+  // The dynamic casters: the snowball and the barriers
+  if (draw_dynamic) {
+    // Draw snowball
+    GLfloat radius = snowball.getRadius();
+    model = glm::translate(glm::mat4(), glm::vec3(currentX, currentY, currentZ));
 #ifdef _WIN32
-  model = glm::rotate(model, deg2rad(snowball.getRotAngle()), glm::vec3(-1.0f, 0.0f, 0.0f));
+    model = glm::rotate(model, deg2rad(snowball.getRotAngle()), glm::vec3(-1.0f, 0.0f, 0.0f));
 #else
-  model = glm::rotate(model, snowball.getRotAngle(), glm::vec3(-1.0f, 0.0f, 0.0f));
+    model = glm::rotate(model, snowball.getRotAngle(), glm::vec3(-1.0f, 0.0f, 0.0f));
 #endif
-  model = glm::scale(model, glm::vec3(radius, radius, radius));
-  snowball.setModelMatrix(model);
-  snowball.draw(shader);
-  barriers.draw(shader);
+    model = glm::scale(model, glm::vec3(radius, radius, radius));
+    snowball.setModelMatrix(model);
+    if (isVisible(shader, snowball.getBounds()))
+      submitObject(shader, snowball, glm::vec3(model[3]));
+
+    // Barriers (one instanced draw call per type, around the snowball)
+    // The rows are trimmed to the frustum of the pass, the counts are known after the draw
+    barriers.setFrustum(depth_pass ? &shadow_frustum : &camera_frustum);
+    render_queue.submit(PASS_OPAQUE, program, 0, 0, glm::vec3(currentX, currentY, currentZ), [&shader, depth_pass]() {
+      if (depth_pass)
+        barriers.drawDepth(shader);
+      else
+        barriers.draw(shader);
+      CullStats& stats = depth_pass ? depth_cull_stats : main_cull_stats;
+      stats.drawn += barriers.getNumDrawn();
+      stats.culled += barriers.getNumCulled();
+    });
+  }
 
-  // Particle System
-  if (drawSnow) {
-    ps->draw(camera, texture_snowflake.getUnit());
+  // Particle System (all emitters, one draw call per group)
+  // Particles do not cast shadows, so skip them in the depth pass
+  if (!depth_pass) {
+    render_queue.submit(PASS_TRANSPARENT, particle_shader.getProgram(), 0, 0,
+                        glm::vec3(currentX, currentY, currentZ), []() { ps->draw(camera); });
   }
 
-  // Billboard
-  if (shader.getFuncType() != DEPTH) {
-    float lifeLevel = snowball.getRadius();
-    billboard_shader.install();
-    billboard_shader.setUniform1f("lifeLevel", lifeLevel);
-    billboard_shader.uninstall();
-    billboard->draw(camera, texture_billboard.getUnit());
+  // Billboard (HUD, drawn last in this order)
+  if (!depth_pass) {
+    render_queue.submit(PASS_OVERLAY, 0, 0, 0, glm::vec3(0.0f), []() {
+      billboard_shader.install();
+      billboard_shader.setUniform1f("lifeLevel", snowball.getRadius());
+      billboard->draw(camera, texture_billboard.getUnit());
+    });
 
     if (bGameOver)
-      gameover->draw(camera, texture_gameover.getUnit());
+      render_queue.submit(PASS_OVERLAY, 0, 0, 0, glm::vec3(0.0f),
+                          []() { gameover->draw(camera, texture_gameover.getUnit()); });
     else if (bWin)
-      winning->draw(camera, texture_win.getUnit());
+      render_queue.submit(PASS_OVERLAY, 0, 0, 0, glm::vec3(0.0f),
+                          []() { winning->draw(camera, texture_win.getUnit()); });
+  }
+
+  render_queue.execute();
+}
+
+/* Render the shadow map, cascade by cascade
+** The static casters of a cascade are only drawn when its cache is out of date (the
+** cascade moved by a snap step, or the static scene changed). Every frame the cached
+** depth is copied and the dynamic casters are drawn over it. */
+void renderShadowMap() {
+  GLboolean static_bound = false;
+  for (GLuint i = 0; i < NUM_SHADOW_CASCADES; ++i) {
+    if (sm->isCached(i, lightSpaces[i])) continue;
+    if (!static_bound) {
+      sm->bindStatic();
+      static_bound = true;
+    }
+    sm->clearCascade(i);
+    beginCascade(i);
+    renderScene(depth_shader, CASTERS_STATIC);
+    sm->setCached(i, lightSpaces[i]);
+  }
+
+  sm->bind();
+  for (GLuint i = 0; i < NUM_SHADOW_CASCADES; ++i) {
+    beginCascade(i);
+    renderScene(depth_shader, CASTERS_DYNAMIC);
+  }
+  sm->unbind();
+
+  // Back to the barriers seen by the camera (see `updateScene`)
+  barriers.setView(currentZ, 120.0f);
+}
+
+/* Get ready to render the cascade @cascade of the shadow map
+** Only the casters inside its light frustum are drawn (see `isVisible`). */
+void beginCascade(const GLuint& cascade) {
+  sm->setCascade(cascade);
+  depth_shader.install();
+  depth_shader.setUniform1i("cascade", cascade);
+  shadow_frustum.update(lightSpaces[cascade]);
+
+  // The barrier rows near the cascade (the margin covers the slant of the light)
+  barriers.setView(cascadeSpheres[cascade].z, cascadeSpheres[cascade].w + 20.0f);
+}
+
+/* Whether an object with the world space @bounds is drawn in this pass
+** The depth pass tests the light frustum of the cascade being rendered, the other
+** passes the view frustum of the camera. The result is counted in the pass stats. */
+GLboolean isVisible(Shader& shader, const BoundingSphere& bounds) {
+  GLboolean depth_pass = (shader.getFuncType() == DEPTH);
+  const Frustum& frustum = depth_pass ? shadow_frustum : camera_frustum;
+  return (depth_pass ? depth_cull_stats : main_cull_stats).count(frustum.containsSphere(bounds));
+}
+
+/* Submit @object (its model matrix is set already) to the render queue
+** In the depth pass it is drawn through its depth-only path (see `Object::drawDepth`) */
+void submitObject(Shader& shader, Object& object, const glm::vec3& position) {
+  if (shader.getFuncType() == DEPTH) {
+    render_queue.submit(PASS_OPAQUE, shader.getProgram(), 0, object.getDepthVAO(), position,
+                        [&shader, &object]() { object.drawDepth(shader); });
+  } else {
+    GLuint texture = object.getTexture() ? object.getTexture()->getID() : 0;
+    render_queue.submit(PASS_OPAQUE, shader.getProgram(), texture, object.getVAO(), position,
+                        [&shader, &object]() { object.draw(shader); });
   }
 }
 
+/* Submit a mini terrain with the model matrix @model */
+void submitTerrain(Shader& shader, const glm::mat4& model) {
+  if (!isVisible(shader, mini_terrain.getBounds(model))) return;
+
+  GLboolean depth_pass = (shader.getFuncType() == DEPTH);
+  GLuint texture = (!depth_pass && mini_terrain.getTexture()) ? mini_terrain.getTexture()->getID() : 0;
+  GLuint VAO = depth_pass ? mini_terrain.getDepthVAO() : mini_terrain.getVAO();
+  render_queue.submit(PASS_OPAQUE, shader.getProgram(), texture, VAO, glm::vec3(model[3]),
+                      [&shader, model, depth_pass]() {
+                        mini_terrain.setModelMatrix(model);
+                        if (depth_pass)
+                          mini_terrain.drawDepth(shader);
+                        else
+                          mini_terrain.draw(shader);
+                      });
+}
+
+/* Submit the path with the model matrix @model and the texture @texture */
+void submitPath(Shader& shader, const glm::mat4& model, Texture* texture) {
+  if (!isVisible(shader, path.getBounds(model))) return;
+
+  GLboolean depth_pass = (shader.getFuncType() == DEPTH);
+  GLuint VAO = depth_pass ? path.getDepthVAO() : path.getVAO();
+  render_queue.submit(PASS_OPAQUE, shader.getProgram(), depth_pass ? 0 : texture->getID(), VAO, glm::vec3(model[3]),
+                      [&shader, model, texture, depth_pass]() {
+                        path.setModelMatrix(model);
+                        if (depth_pass) {
+                          path.drawDepth(shader);
+                        } else {
+                          path.setTexture(texture);
+                          path.draw(shader);
+                        }
+                      });
+}
+
+/* Close the frame: keep the GL call counters of the frame (see `GLState`) and
+** start counting the culled objects of the next one */
+void endFrame() {
+  glState().endFrame();
+#ifdef GL_STATE_STATS
+  std::print("GL calls: {} issued, {} skipped\n", glState().getLastIssued(), glState().getLastSkipped());
+#endif
+#ifdef CULL_STATS
+  std::print("Culling: main {} drawn, {} culled; depth {} drawn, {} culled\n", main_cull_stats.drawn,
+             main_cull_stats.culled, depth_cull_stats.drawn, depth_cull_stats.culled);
+#endif
+  main_cull_stats.reset();
+  depth_cull_stats.reset();
+}
+
 int main() {
   initGL();
   initScene();
@@ -692,10 +1001,9 @@ int main() {
 
     // Check and call events
     glfwPollEvents();
+    Shader::finishReady();
     updateScene();
-    sm->bind();
-    renderScene(depth_shader);
-    sm->unbind();
+    renderShadowMap();
 
     glViewport(0, 0, window_width, window_height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -708,6 +1016,7 @@ int main() {
 
     // This line must be here! Or the screen will flash!
     glfwSwapBuffers(window);
+    endFrame();
   }
 
   while (!glfwWindowShouldClose(window)) {
@@ -719,12 +1028,11 @@ int main() {
 
     // Check and call events
     glfwPollEvents();
+    Shader::finishReady();
     move_func();
     updateScene();
 
-    sm->bind();
-    renderScene(depth_shader);
-    sm->unbind();
+    renderShadowMap();
 
     glViewport(0, 0, window_width, window_height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -733,12 +1041,68 @@ int main() {
 
     // This line must be here! Or the screen will flash!
     glfwSwapBuffers(window);
+    endFrame();
   }
 
   glfwTerminate();
   return 0;
 }
 
+/* Returns the height of the ground at given x-z (world) coordinates
+** The path is a flat plane at y = 0. The terrains (if drawn) are sampled from their
+** height data. Their model matrices are pure translations. */
+GLfloat groundHeight(const GLfloat& x, const GLfloat& z) {
+  GLfloat height = 0.0f;
+  for (GLuint i = 0; i < num_terrain; ++i) {
+    if (drawTerrainA) {
+      glm::vec3 corner(terrainModelMatsA[i][3]);
+      if (mini_terrain.contains(x - corner.x, z - corner.z))
+        height = glm::max(height, corner.y + mini_terrain.getAltitude(x - corner.x, z - corner.z));
+    }
+    if (drawTerrainB) {
+      glm::vec3 corner(terrainModelMatsB[i][3]);
+      if (mini_terrain.contains(x - corner.x, z - corner.z))
+        height = glm::max(height, corner.y + mini_terrain.getAltitude(x - corner.x, z - corner.z));
+    }
+  }
+  return height;
+}
+
+/* Collect the placements of trees (of the scenes with plants) and show the grass
+** segments of these scenes. The trees visible in a pass are uploaded by `renderScene`.
+** Call it whenever the matrices or drawPlantA/B change. */
+void updatePlantInstances() {
+  tree_instances.clear();
+  if (drawPlantA)
+    tree_instances.insert(tree_instances.end(), treeModelMatsA.begin(), treeModelMatsA.end());
+  if (drawPlantB)
+    tree_instances.insert(tree_instances.end(), treeModelMatsB.begin(), treeModelMatsB.end());
+  tree_lods.assign(tree_instances.size(), 0);
+  tree_impostors.assign(tree_instances.size(), false);
+  grass_field->setVisible(0, drawPlantA);
+  grass_field->setVisible(1, drawPlantB);
+
+  // The static shadow casters changed
+  sm->invalidate();
+}
+
+/* Pick the level of detail of the trees and the snow house from their size on screen
+** (see `selectLod`), the shadow pass draws the levels picked for the camera too
+** The trees beyond `impostor_distance` are drawn as impostors (with the same margin)
+** @param proj_scale: The element [1][1] of the projection matrix */
+void updateLods(const glm::vec3& eye, const GLfloat& proj_scale) {
+  GLuint num_lods = tree.getNumLods();
+  for (GLuint i = 0; i < tree_instances.size(); ++i) {
+    BoundingSphere bounds = tree.getBounds(tree_instances[i]);
+    tree_lods[i] = selectLod(tree_lods[i], lodScreenSize(bounds, eye, proj_scale), num_lods);
+    GLfloat margin = tree_impostors[i] ? 1.0f - LOD_HYSTERESIS : 1.0f + LOD_HYSTERESIS;
+    tree_impostors[i] = glm::length(bounds.center - eye) > impostor_distance * margin;
+  }
+
+  GLfloat house_size = lodScreenSize(snowhouse.getBounds(snowhouse.getModelMatrix()), eye, proj_scale);
+  snowhouse.setLod(selectLod(snowhouse.getLod(), house_size, snowhouse.getNumLods()));
+}
+
 /* Moves/alters the camera positions based on user input */
 void move_func() {
   // Camera controls
@@ -0,0 +1,438 @@
+/*******************************************************************************
+** Software License Agreement (GNU GENERAL PUBLIC LICENSE)
+**
+** Copyright 2016-2017  Peiyu Liao (enzoliao95@gmail.com). All rights reserved.
+** Copyright 2016-2017  Yaohong Wu (wuyaohongdio@gmail.com). All rights reserved.
+**
+** LICENSE INFORMATION (GPL)
+** SEE `LICENSE` FILE.
+*******************************************************************************/
+
+#ifndef _MESH_LOD_H_
+#define _MESH_LOD_H_
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <glm/glm.hpp>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "frustum.h"
+
+/* The number of levels of detail of a mesh (level 0 is the full mesh) */
+const GLuint MAX_MESH_LODS = 4;
+
+/* The share of the triangles of the full mesh kept by each level */
+static const GLfloat lod_ratios[MAX_MESH_LODS] = {1.0f, 0.5f, 0.25f, 0.1f};
+
+/* The projected size (see `lodScreenSize`) below which level i switches to level i + 1 */
+static const GLfloat lod_screen_sizes[MAX_MESH_LODS - 1] = {0.3f, 0.12f, 0.05f};
+
+/* The margin around the switch sizes, an object on a boundary does not pop back and forth */
+const GLfloat LOD_HYSTERESIS = 0.15f;
+
+/* Meshes with fewer triangles are not simplified */
+const GLuint LOD_MIN_TRIANGLES = 128;
+
+/* STRUCT: A level of detail of a mesh
+** @param first, count: The range of its indices in the index buffer of the mesh */
+struct MeshLod {
+  GLuint first;
+  GLuint count;
+};
+
+/* The size of @bounds on screen, as a share of the screen height
+** @param proj_scale: The element [1][1] of the projection matrix (1 / tan(fovy / 2)) */
+static GLfloat lodScreenSize(const BoundingSphere& bounds, const glm::vec3& eye, const GLfloat& proj_scale) {
+  if (bounds.radius < 0.0f) return 1.0f;
+  GLfloat distance = glm::max(glm::length(bounds.center - eye), 0.001f);
+  return bounds.radius * proj_scale / distance;
+}
+
+/* The level of detail for an object of projected size @screen_size, drawn at level
+** @current last frame. The level only changes once the size is past the switch size
+** by more than the hysteresis margin. */
+static GLuint selectLod(const GLuint& current, const GLfloat& screen_size, const GLuint& num_lods) {
+  if (num_lods == 0) return 0;
+  GLuint lod = glm::min(current, num_lods - 1);
+  while (lod > 0 && screen_size > lod_screen_sizes[lod - 1] * (1.0f + LOD_HYSTERESIS)) lod--;
+  while (lod + 1 < num_lods && screen_size < lod_screen_sizes[lod] * (1.0f - LOD_HYSTERESIS)) lod++;
+  return lod;
+}
+
+/* CLASS: Mesh simplifier
+** Quadric error decimation (Garland & Heckbert): the edge whose collapse moves the
+** surface least is collapsed first, until the number of triangles is reached.
+** An edge collapses onto one of its vertices, so the levels index the vertices of the
+** full mesh and share its vertex buffer.
+** The vertices split along texture seams are welded by position for the collapses,
+** each corner then picks the vertex of the kept position with the closest texture
+** coordinates. The open borders (e.g. leaf cards) are kept by extra quadrics. */
+class MeshSimplifier {
+ public:
+  /* Constructor
+  ** @param _tex_coords: The texture coordinates of the vertices (may be empty) */
+  MeshSimplifier(const std::vector<glm::vec3>& _positions,
+                 const std::vector<glm::vec2>& _tex_coords,
+                 const std::vector<GLuint>& indices)
+      : positions(_positions),
+        tex_coords(_tex_coords),
+        corners(indices),
+        num_triangles(0) {
+    weld();
+    init();
+  }
+
+  /* Returns the number of triangles left */
+  const GLuint getNumTriangles() { return num_triangles; }
+
+  /* Collapse edges until @target triangles are left (or no edge can collapse) and
+  ** return the indices of the triangles left. Each call goes on from the last one. */
+  std::vector<GLuint> simplify(const GLuint& target) {
+    while (num_triangles > target && !heap.empty()) {
+      Collapse collapse = heap.top();
+      heap.pop();
+      if (removed[collapse.from] || removed[collapse.to]) continue;
+      if (collapse.stamp_from != stamps[collapse.from] || collapse.stamp_to != stamps[collapse.to]) continue;
+      if (!canCollapse(collapse.from, collapse.to)) continue;
+      collapseEdge(collapse.from, collapse.to);
+    }
+
+    std::vector<GLuint> indices;
+    indices.reserve(num_triangles * 3);
+    for (GLuint t = 0; t < dead.size(); ++t) {
+      if (dead[t]) continue;
+      indices.insert(indices.end(), corners.begin() + 3 * t, corners.begin() + 3 * t + 3);
+    }
+    return indices;
+  }
+
+  /* Build the simplified levels of a mesh (level 1 on, see `lod_ratios`)
+  ** The levels are cached on disk, keyed by the mesh (see `cacheDirectory`). A level
+  ** which does not remove enough triangles ends the list. */
+  static std::vector<std::vector<GLuint> > buildLevels(const std::vector<glm::vec3>& positions,
+                                                       const std::vector<glm::vec2>& tex_coords,
+                                                       const std::vector<GLuint>& indices) {
+    std::vector<std::vector<GLuint> > levels;
+    GLuint full = indices.size() / 3;
+    if (full < LOD_MIN_TRIANGLES) return levels;
+
+    GLuint64 hash = hashMesh(positions, tex_coords, indices);
+    if (loadLevels(hash, levels)) return levels;
+
+    MeshSimplifier simplifier(positions, tex_coords, indices);
+    GLuint last = full;
+    for (GLuint i = 1; i < MAX_MESH_LODS; ++i) {
+      std::vector<GLuint> level = simplifier.simplify((GLuint)(full * lod_ratios[i]));
+      if (level.empty() || level.size() / 3 > 0.8f * last) break;
+      last = level.size() / 3;
+      levels.push_back(level);
+    }
+    saveLevels(hash, levels);
+    return levels;
+  }
+
+  /* The directory of the level cache (see `buildLevels`) */
+  static std::string& cacheDirectory() {
+    static std::string directory = "../mesh_cache/";
+    return directory;
+  }
+
+ private:
+  /* The weight of the quadrics keeping the open borders */
+  static constexpr GLdouble BORDER_WEIGHT = 100.0;
+
+  /* STRUCT: A candidate collapse of the position @from onto the position @to
+  ** @param stamp_from, stamp_to: The stamps of both positions when the cost was computed */
+  struct Collapse {
+    GLdouble cost;
+    GLuint from, to;
+    GLuint stamp_from, stamp_to;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+  };
+
+  /* PRIVATE MEMBER
+  ** Give the same position to the vertices at the same place */
+  void weld() {
+    std::vector<GLuint> order(positions.size());
+    for (GLuint i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [this](const GLuint& a, const GLuint& b) {
+      const glm::vec3 &p = positions[a], &q = positions[b];
+      if (p.x != q.x) return p.x < q.x;
+      if (p.y != q.y) return p.y < q.y;
+      return p.z < q.z;
+    });
+
+    position_of.resize(positions.size());
+    for (GLuint i = 0; i < order.size(); ++i) {
+      if (i == 0 || positions[order[i]] != positions[order[i - 1]]) {
+        points.push_back(positions[order[i]]);
+        vertices_at.push_back(std::vector<GLuint>());
+      }
+      position_of[order[i]] = points.size() - 1;
+      vertices_at.back().push_back(order[i]);
+    }
+  }
+
+  /* PRIVATE MEMBER
+  ** Build the quadrics, the triangles of each position and the first candidates */
+  void init() {
+    GLuint num_points = points.size();
+    quadrics.assign(num_points, glm::dmat4(0.0));
+    stamps.assign(num_points, 0);
+    removed.assign(num_points, false);
+    triangles_at.resize(num_points);
+    dead.assign(corners.size() / 3, false);
+
+    // The plane of each triangle, weighted by its area
+    std::unordered_map<GLuint64, GLuint> edge_count;
+    for (GLuint t = 0; t < dead.size(); ++t) {
+      glm::vec3 normal = triangleNormal(t);
+      GLfloat area = 0.5f * glm::length(normal);
+      if (area <= 0.0f || isDegenerate(t)) {
+        dead[t] = true;
+        continue;
+      }
+      num_triangles++;
+      normal = glm::normalize(normal);
+      glm::dvec4 plane(normal, -glm::dot(normal, points[cornerPosition(t, 0)]));
+      for (GLuint k = 0; k < 3; ++k) {
+        quadrics[cornerPosition(t, k)] += (GLdouble)area * glm::outerProduct(plane, plane);
+        triangles_at[cornerPosition(t, k)].push_back(t);
+        edge_count[edgeKey(cornerPosition(t, k), cornerPosition(t, (k + 1) % 3))]++;
+      }
+    }
+
+    // The open borders: a plane through the edge, across the triangle
+    for (GLuint t = 0; t < dead.size(); ++t) {
+      if (dead[t]) continue;
+      glm::vec3 normal = glm::normalize(triangleNormal(t));
+      for (GLuint k = 0; k < 3; ++k) {
+        GLuint a = cornerPosition(t, k), b = cornerPosition(t, (k + 1) % 3);
+        if (edge_count[edgeKey(a, b)] != 1) continue;
+        glm::vec3 edge = points[b] - points[a];
+        glm::vec3 across = glm::cross(edge, normal);
+        if (glm::length(across) <= 0.0f) continue;
+        across = glm::normalize(across);
+        glm::dvec4 plane(across, -glm::dot(across, points[a]));
+        glm::dmat4 border = BORDER_WEIGHT * (GLdouble)glm::dot(edge, edge) * glm::outerProduct(plane, plane);
+        quadrics[a] += border;
+        quadrics[b] += border;
+      }
+    }
+
+    for (GLuint t = 0; t < dead.size(); ++t) {
+      if (dead[t]) continue;
+      for (GLuint k = 0; k < 3; ++k) {
+        GLuint a = cornerPosition(t, k), b = cornerPosition(t, (k + 1) % 3);
+        pushCollapse(a, b);
+        pushCollapse(b, a);
+      }
+    }
+  }
+
+  /* PRIVATE MEMBER
+  ** Whether collapsing @from onto @to keeps the triangles around @from facing the
+  ** same way (a flipped or squashed triangle rejects the collapse) */
+  GLboolean canCollapse(const GLuint& from, const GLuint& to) {
+    std::vector<GLuint>& triangles = triangles_at[from];
+    for (GLuint i = 0; i < triangles.size(); ++i) {
+      GLuint t = triangles[i];
+      if (dead[t] || hasPosition(t, to)) continue;
+      glm::vec3 moved[3];
+      for (GLuint k = 0; k < 3; ++k) {
+        GLuint p = cornerPosition(t, k);
+        moved[k] = points[p == from ? to : p];
+      }
+      glm::vec3 before = triangleNormal(t);
+      glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+      if (glm::dot(before, after) <= 0.2f * glm::length(before) * glm::length(after)) return false;
+    }
+    return true;
+  }
+
+  /* PRIVATE MEMBER
+  ** Collapse the position @from onto the position @to */
+  void collapseEdge(const GLuint& from, const GLuint& to) {
+    std::vector<GLuint>& triangles = triangles_at[from];
+    for (GLuint i = 0; i < triangles.size(); ++i) {
+      GLuint t = triangles[i];
+      if (dead[t]) continue;
+      if (hasPosition(t, to)) {
+        dead[t] = true;
+        num_triangles--;
+        continue;
+      }
+      for (GLuint k = 0; k < 3; ++k) {
+        if (cornerPosition(t, k) == from) corners[3 * t + k] = closestVertex(corners[3 * t + k], to);
+      }
+      triangles_at[to].push_back(t);
+    }
+    quadrics[to] += quadrics[from];
+    removed[from] = true;
+    triangles.clear();
+    stamps[to]++;
+
+    // Drop the dead triangles of @to and update the costs of its edges
+    std::vector<GLuint>& kept = triangles_at[to];
+    kept.erase(std::remove_if(kept.begin(), kept.end(), [this](const GLuint& t) { return (bool)dead[t]; }),
+               kept.end());
+    for (GLuint i = 0; i < kept.size(); ++i) {
+      for (GLuint k = 0; k < 3; ++k) {
+        GLuint p = cornerPosition(kept[i], k);
+        if (p == to) continue;
+        pushCollapse(to, p);
+        pushCollapse(p, to);
+      }
+    }
+  }
+
+  /* PRIVATE MEMBER: Queue the collapse of @from onto @to */
+  void pushCollapse(const GLuint& from, const GLuint& to) {
+    glm::dvec4 point(points[to], 1.0);
+    GLdouble cost = glm::dot(point, (quadrics[from] + quadrics[to]) * point);
+    Collapse collapse = {cost, from, to, stamps[from], stamps[to]};
+    heap.push(collapse);
+  }
+
+  /* PRIVATE MEMBER
+  ** The vertex at the position @to whose texture coordinates are the closest to @vertex */
+  GLuint closestVertex(const GLuint& vertex, const GLuint& to) {
+    std::vector<GLuint>& candidates = vertices_at[to];
+    if (tex_coords.empty()) return candidates[0];
+    GLuint best = candidates[0];
+    GLfloat best_distance = glm::length(tex_coords[best] - tex_coords[vertex]);
+    for (GLuint i = 1; i < candidates.size(); ++i) {
+      GLfloat distance = glm::length(tex_coords[candidates[i]] - tex_coords[vertex]);
+      if (distance < best_distance) {
+        best = candidates[i];
+        best_distance = distance;
+      }
+    }
+    return best;
+  }
+
+  /* PRIVATE MEMBERS: Helpers on the triangle @t */
+  GLuint cornerPosition(const GLuint& t, const GLuint& k) const { return position_of[corners[3 * t + k]]; }
+  GLboolean hasPosition(const GLuint& t, const GLuint& p) const {
+    return cornerPosition(t, 0) == p || cornerPosition(t, 1) == p || cornerPosition(t, 2) == p;
+  }
+  GLboolean isDegenerate(const GLuint& t) const {
+    return cornerPosition(t, 0) == cornerPosition(t, 1) || cornerPosition(t, 1) == cornerPosition(t, 2) ||
+           cornerPosition(t, 2) == cornerPosition(t, 0);
+  }
+  glm::vec3 triangleNormal(const GLuint& t) const {
+    glm::vec3 a = points[cornerPosition(t, 0)], b = points[cornerPosition(t, 1)], c = points[cornerPosition(t, 2)];
+    return glm::cross(b - a, c - a);
+  }
+  static GLuint64 edgeKey(const GLuint& a, const GLuint& b) {
+    return a < b ? ((GLuint64)a << 32) | b : ((GLuint64)b << 32) | a;
+  }
+
+  /* PRIVATE MEMBER
+  ** A hash of the mesh and of the level settings, stable between runs (FNV-1a) */
+  static GLuint64 hashMesh(const std::vector<glm::vec3>& positions,
+                           const std::vector<glm::vec2>& tex_coords,
+                           const std::vector<GLuint>& indices) {
+    GLuint64 hash = 14695981039346656037ull;
+    std::function<void(const void*, size_t)> mix = [&hash](const void* data, size_t size) {
+      const unsigned char* bytes = (const unsigned char*)data;
+      for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+      }
+    };
+    mix(lod_ratios, sizeof(lod_ratios));
+    mix(&LOD_MIN_TRIANGLES, sizeof(LOD_MIN_TRIANGLES));
+    if (!positions.empty()) mix(&positions[0], positions.size() * sizeof(glm::vec3));
+    if (!tex_coords.empty()) mix(&tex_coords[0], tex_coords.size() * sizeof(glm::vec2));
+    if (!indices.empty()) mix(&indices[0], indices.size() * sizeof(GLuint));
+    return hash;
+  }
+
+  /* PRIVATE MEMBER
+  ** Load the levels of the mesh with the hash @hash from the cache
+  ** The file holds the number of levels, then the number of indices and the indices
+  ** of each level. A missing or short file returns false (simplify the mesh then). */
+  static GLboolean loadLevels(const GLuint64& hash, std::vector<std::vector<GLuint> >& levels) {
+    std::ifstream file(cachePath(hash), std::ios::binary);
+    if (!file) return false;
+    GLuint num_levels = 0;
+    file.read((char*)&num_levels, sizeof(num_levels));
+    if (!file || num_levels >= MAX_MESH_LODS) return false;
+
+    std::vector<std::vector<GLuint> > loaded(num_levels);
+    for (GLuint i = 0; i < num_levels; ++i) {
+      GLuint count = 0;
+      file.read((char*)&count, sizeof(count));
+      if (!file) return false;
+      loaded[i].resize(count);
+      if (count > 0) file.read((char*)&loaded[i][0], count * sizeof(GLuint));
+      if (!file) return false;
+    }
+    levels.swap(loaded);
+    return true;
+  }
+
+  /* PRIVATE MEMBER
+  ** Write the levels of the mesh with the hash @hash to the cache (failures are ignored) */
+  static void saveLevels(const GLuint64& hash, const std::vector<std::vector<GLuint> >& levels) {
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory(), error);
+    std::ofstream file(cachePath(hash), std::ios::binary | std::ios::trunc);
+    if (!file) return;
+    GLuint num_levels = levels.size();
+    file.write((const char*)&num_levels, sizeof(num_levels));
+    for (GLuint i = 0; i < num_levels; ++i) {
+      GLuint count = levels[i].size();
+      file.write((const char*)&count, sizeof(count));
+      if (count > 0) file.write((const char*)&levels[i][0], count * sizeof(GLuint));
+    }
+  }
+
+  /* PRIVATE MEMBER: The file of the mesh with the hash @hash in the cache */
+  static std::string cachePath(const GLuint64& hash) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.lod", (unsigned long long)hash);
+    return cacheDirectory() + name;
+  }
+
+  /* PRIVATE MEMBERS
+  ** @param positions, tex_coords: The vertices of the full mesh
+  ** @param corners: The vertices of each triangle (3 per triangle)
+  ** @param dead: Whether each triangle is collapsed */
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec2> tex_coords;
+  std::vector<GLuint> corners;
+  std::vector<GLboolean> dead;
+  GLuint num_triangles;
+
+  /* PRIVATE MEMBERS: The welded positions
+  ** @param position_of: The position of each vertex
+  ** @param points, vertices_at: The place and the vertices of each position
+  ** @param quadrics: The error quadric of each position
+  ** @param stamps: Bumped when the quadric or the triangles of the position change
+  ** @param removed: Whether the position is collapsed onto another one
+  ** @param triangles_at: The triangles around each position */
+  std::vector<GLuint> position_of;
+  std::vector<glm::vec3> points;
+  std::vector<std::vector<GLuint> > vertices_at;
+  std::vector<glm::dmat4> quadrics;
+  std::vector<GLuint> stamps;
+  std::vector<GLboolean> removed;
+  std::vector<std::vector<GLuint> > triangles_at;
+
+  /* PRIVATE MEMBER
+  ** The candidate collapses, cheapest first (the stale ones are skipped when popped) */
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > heap;
+};
+
+#endif
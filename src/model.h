@@ -21,6 +21,8 @@
 #include <string>
 #include <vector>
 
+#include "gl_state.h"
+#include "mesh_lod.h"
 #include "objects.h"
 #include "shader.hpp"
 #include "texture.h"
@@ -48,6 +50,9 @@ class Mesh {
   std::vector<GLuint> indices;
   std::vector<Texture> textures;
   GLuint VAO;
+  GLuint depthVAO;  // Positions only, for the depth pass
+  BoundingSphere bounds;  // In model space
+  std::vector<MeshLod> lods;  // Level 0 is `indices`, the others are simplified (see `setup`)
 
   /* Default constructor & Constructor */
   Mesh(std::vector<MeshVertex> _vertices,
@@ -55,22 +60,104 @@ class Mesh {
        std::vector<Texture> _textures)
       : vertices(_vertices),
         indices(_indices),
-        textures(_textures) {
+        textures(_textures),
+        instanceVBO(0) {
     // Set up the mesh
     setup();
+    if (!vertices.empty())
+      bounds = BoundingSphere::fromPoints(&vertices[0].position.x, vertices.size(),
+                                          sizeof(MeshVertex) / sizeof(GLfloat));
   }
 
-  // Render the mesh
-  void draw(Shader shader) {
+  // Render the mesh at the level of detail @lod
+  void draw(Shader shader, const GLuint& lod = 0) {
     shader.install();
-    // Bind appropriate textures
+    bindTextures(shader);
+
+    // draw mesh
+    const MeshLod& level = getLod(lod);
+    glState().bindVertexArray(this->VAO);
+    glDrawElements(GL_TRIANGLES, level.count, GL_UNSIGNED_INT, (GLvoid*)(level.first * sizeof(GLuint)));
+  }
+
+  // Render @count instances of the mesh in one call, at the level of detail @lod
+  // The model matrices are read from the instance buffer (see `setInstanceBuffer`),
+  // from the instance @first_instance on
+  void drawInstanced(Shader shader, const GLuint& count, const GLuint& lod = 0, const GLuint& first_instance = 0) {
+    shader.install();
+    bindTextures(shader);
+
+    const MeshLod& level = getLod(lod);
+    glState().bindVertexArray(this->VAO);
+    setFirstInstance(0, first_instance);
+    glDrawElementsInstanced(GL_TRIANGLES, level.count, GL_UNSIGNED_INT, (GLvoid*)(level.first * sizeof(GLuint)), count);
+  }
+
+  // Render @count instances of the mesh into the shadow map
+  // No texture is bound, only the positions are streamed (see `depthVAO`)
+  void drawDepth(const GLuint& count, const GLuint& lod = 0, const GLuint& first_instance = 0) {
+    const MeshLod& level = getLod(lod);
+    glState().bindVertexArray(this->depthVAO);
+    setFirstInstance(1, first_instance);
+    glDrawElementsInstanced(GL_TRIANGLES, level.count, GL_UNSIGNED_INT, (GLvoid*)(level.first * sizeof(GLuint)), count);
+  }
+
+  // Attach a buffer of per-instance model matrices to the mesh (both VAOs)
+  // A mat4 attribute takes 4 locations (5 ~ 8), one column each
+  void setInstanceBuffer(const GLuint& buffer) {
+    GLuint VAOs[] = {VAO, depthVAO};
+    instanceVBO = buffer;
+    for (GLuint v = 0; v < 2; v++) {
+      glState().bindVertexArray(VAOs[v]);
+      for (GLuint i = 0; i < 4; i++) {
+        glEnableVertexAttribArray(5 + i);
+        glVertexAttribDivisor(5 + i, 1);
+      }
+      instance_offsets[v] = 1;  // Not pointed yet
+      setFirstInstance(v, 0);
+    }
+    glState().bindVertexArray(0);
+  }
+
+ private:
+  /*  Render data  */
+  GLuint VBO, EBO;
+  GLuint positionVBO;  // The positions of `vertices`, tightly packed
+
+  /*  Instance data  */
+  GLuint instanceVBO;          // The buffer of per-instance model matrices (0: none)
+  GLuint instance_offsets[2];  // The first instance read by `VAO` and `depthVAO`
+
+  /* PRIVATE MEMBER: The level of detail @lod (the coarsest one if there are fewer) */
+  const MeshLod& getLod(const GLuint& lod) const { return lods[glm::min(lod, (GLuint)lods.size() - 1)]; }
+
+  /* PRIVATE MEMBER
+  ** Point the instance attributes of the bound VAO (0: `VAO`, 1: `depthVAO`) at the
+  ** instance @first (GL 3.3 has no base instance). Skipped when they point there already. */
+  void setFirstInstance(const GLuint& v, const GLuint& first) {
+    if (instanceVBO == 0 || instance_offsets[v] == first) return;
+    instance_offsets[v] = first;
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    for (GLuint i = 0; i < 4; i++) {
+      GLsizeiptr offset = first * sizeof(glm::mat4) + i * sizeof(glm::vec4);
+      glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)offset);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  /* The sampler names of the textures, e.g. "material.diffuse1" (see `bindTextures`) */
+  std::vector<UniformName> sampler_names;
+
+  /* PRIVATE MEMBER: Build the sampler names of the textures
+  ** Only done when the textures change, not every draw */
+  void updateSamplerNames() {
     GLuint diffuseNr = 1;
     GLuint specularNr = 1;
     GLuint normalNr = 1;
     GLuint heightNr = 1;
 
+    sampler_names.clear();
     for (GLuint i = 0; i < this->textures.size(); i++) {
-      // GLuint temp;
       std::string number;
       std::string name = this->textures[i].getType();
       if (name == "diffuse")
@@ -81,47 +168,54 @@ class Mesh {
         number = std::to_string(normalNr++);
       else if (name == "texture_height")
         number = std::to_string(heightNr++);
-
-      // Set the sampler to the correct texture unit
-      glUniform1i(glGetUniformLocation(shader.getProgram(), ("material." + name + number).c_str()), i + 1);
-      // Active proper texture unit before binding
-      glActiveTexture(GL_TEXTURE0 + i + 1);
-      // And finally bind the texture
-      glBindTexture(GL_TEXTURE_2D, this->textures[i].getID());
+      sampler_names.push_back(UniformName("material." + name + number));
     }
+  }
 
-    // draw mesh
-    glBindVertexArray(this->VAO);
-    glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-
-    shader.uninstall();
+  /* PRIVATE MEMBER: Bind appropriate textures of the mesh */
+  void bindTextures(Shader& shader) {
+    if (sampler_names.size() != this->textures.size())
+      updateSamplerNames();
 
-    // set everything back to defaults once configured.
     for (GLuint i = 0; i < this->textures.size(); i++) {
-      glActiveTexture(GL_TEXTURE0 + i + 1);
-      glBindTexture(GL_TEXTURE_2D, 0);
+      // Set the sampler to the correct texture unit
+      shader.setUniform1i(sampler_names[i], i + 1);
+      // Bind the texture (skipped if it is bound to the unit already)
+      glState().bindTexture(i + 1, this->textures[i].getID());
     }
   }
 
- private:
-  /*  Render data  */
-  GLuint VBO, EBO;
-
   /* PRIVATE MEMBER: Do mesh SET UP.
   ** Initializes all the buffer objects/arrays */
   void setup() {
+    std::vector<glm::vec3> positions(vertices.size());
+    std::vector<glm::vec2> tex_coords(vertices.size());
+    for (GLuint i = 0; i < vertices.size(); i++) {
+      positions[i] = vertices[i].position;
+      tex_coords[i] = vertices[i].texCoords;
+    }
+
+    // The simplified levels follow the full mesh in the index buffer
+    std::vector<GLuint> elements = indices;
+    std::vector<std::vector<GLuint> > levels = MeshSimplifier::buildLevels(positions, tex_coords, indices);
+    lods.clear();
+    lods.push_back(MeshLod{0, (GLuint)indices.size()});
+    for (GLuint i = 0; i < levels.size(); i++) {
+      lods.push_back(MeshLod{(GLuint)elements.size(), (GLuint)levels[i].size()});
+      elements.insert(elements.end(), levels[i].begin(), levels[i].end());
+    }
+
     // Create VAO (arrays), VBO and EBO (buffers)
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &this->VBO);
     glGenBuffers(1, &this->EBO);
-    glBindVertexArray(VAO);
+    glState().bindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
     // The memory layout of structs is sequential for all its items.
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex), &vertices[0], GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size() * sizeof(GLuint), &elements[0], GL_STATIC_DRAW);
 
     // Set the vertex attribute pointers
     glEnableVertexAttribArray(0);
@@ -134,10 +228,26 @@ class Mesh {
     glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (GLvoid*)offsetof(MeshVertex, tangent));
     glEnableVertexAttribArray(4);
     glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (GLvoid*)offsetof(MeshVertex, bitangent));
-    glBindVertexArray(0);
+    glState().bindVertexArray(0);
+
+    // The depth pass reads the positions only, from their own buffer (12 bytes per
+    // vertex instead of 56), and shares the indices
+    glGenVertexArrays(1, &depthVAO);
+    glGenBuffers(1, &positionVBO);
+    glState().bindVertexArray(depthVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+    glState().bindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
   }
 };
 
+/* Interned names of the uniforms set for every model (see main.vert) */
+static const UniformName uniform_instanced("instanced");
+
 class Model : public Object {
  public:
   /*  Model Data */
@@ -145,7 +255,7 @@ class Model : public Object {
   std::vector<Mesh> meshes;
   std::string directory;
 
-  Model() {
+  Model() : instanceVBO(0), num_instances(0), lod(0) {
     Object::texture_ptr = NULL;  // No need to use this variable
     Object::kd = 1.0;            // Set default kd, ks, shininess
     Object::ks = 0.0;
@@ -154,12 +264,13 @@ class Model : public Object {
 
   /*  Functions   */
   // Constructor, expects a filepath to a 3D model.
-  Model(const std::string& path) {
+  Model(const std::string& path) : instanceVBO(0), num_instances(0), lod(0) {
     this->loadModel(path);
   }
 
   Model(const std::string& model_path, const std::string& texture_path,
-        const std::string& type = "diffuse") {
+        const std::string& type = "diffuse")
+      : instanceVBO(0), num_instances(0), lod(0) {
     this->loadModel(model_path);
 
     if (textures_loaded.size() == 0) {
@@ -167,18 +278,88 @@ class Model : public Object {
     }
   }
 
+  // The number of levels of detail (of the mesh with the most levels)
+  const GLuint getNumLods() {
+    GLuint num_lods = 1;
+    for (GLuint i = 0; i < this->meshes.size(); i++)
+      num_lods = glm::max(num_lods, (GLuint)this->meshes[i].lods.size());
+    return num_lods;
+  }
+
+  // The level of detail of `draw` and `drawDepth` (see `selectLod`)
+  const GLuint getLod() { return lod; }
+  void setLod(const GLuint& _lod) { lod = _lod; }
+
   // draws the model, and thus all its meshes
   void draw(Shader shader) {
     shader.install();
-    if (shader.getFuncType() == NORMAL) {
-      shader.setUniform1f("material.kd", kd);
-      shader.setUniform1f("material.ks", ks);
-      shader.setUniform1f("material.shininess", shininess);
-    }
-    shader.setUniformMatrix4fv("model", model2world);
+    setObjectData(model2world);
+    for (GLuint i = 0; i < this->meshes.size(); i++)
+      this->meshes[i].draw(shader, lod);
+  }
+
+  // draws the model into the shadow map (no textures, positions only)
+  void drawDepth(Shader shader) {
+    shader.install();
+    setObjectData(model2world);
     for (GLuint i = 0; i < this->meshes.size(); i++)
-      this->meshes[i].draw(shader);
-    shader.uninstall();
+      this->meshes[i].drawDepth(1, lod);
+  }
+
+  // Upload the model matrices of all placements of the model (all at level 0)
+  void setInstances(const std::vector<glm::mat4>& model_mats) {
+    setInstances(model_mats, std::vector<GLuint>(model_mats.size(), 0));
+  }
+
+  // Upload the model matrices of all placements of the model and their levels of detail
+  // The placements are grouped by level, so each level is one draw call per mesh
+  // The buffer is created (and attached to every mesh) on the first call
+  void setInstances(const std::vector<glm::mat4>& model_mats, const std::vector<GLuint>& lods) {
+    if (instanceVBO == 0) {
+      glGenBuffers(1, &instanceVBO);
+      for (GLuint i = 0; i < this->meshes.size(); i++)
+        this->meshes[i].setInstanceBuffer(instanceVBO);
+    }
+
+    std::vector<glm::mat4> sorted;
+    sorted.reserve(model_mats.size());
+    for (GLuint l = 0; l < MAX_MESH_LODS; l++) {
+      lod_first[l] = sorted.size();
+      for (GLuint i = 0; i < model_mats.size(); i++)
+        if (glm::min(lods[i], MAX_MESH_LODS - 1) == l) sorted.push_back(model_mats[i]);
+      lod_count[l] = sorted.size() - lod_first[l];
+    }
+
+    num_instances = sorted.size();
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, num_instances * sizeof(glm::mat4), num_instances ? &sorted[0] : NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  // draws all placements set by `setInstances`, one draw call per mesh and level
+  void drawInstanced(Shader shader) {
+    if (num_instances == 0) return;
+    shader.install();
+    setObjectData(glm::mat4());
+    shader.setUniform1i(uniform_instanced, true);
+    for (GLuint i = 0; i < this->meshes.size(); i++) {
+      for (GLuint l = 0; l < MAX_MESH_LODS; l++)
+        if (lod_count[l] > 0) this->meshes[i].drawInstanced(shader, lod_count[l], l, lod_first[l]);
+    }
+    shader.setUniform1i(uniform_instanced, false);
+  }
+
+  // draws all placements set by `setInstances` into the shadow map
+  void drawDepthInstanced(Shader shader) {
+    if (num_instances == 0) return;
+    shader.install();
+    setObjectData(glm::mat4());
+    shader.setUniform1i(uniform_instanced, true);
+    for (GLuint i = 0; i < this->meshes.size(); i++) {
+      for (GLuint l = 0; l < MAX_MESH_LODS; l++)
+        if (lod_count[l] > 0) this->meshes[i].drawDepth(lod_count[l], l, lod_first[l]);
+    }
+    shader.setUniform1i(uniform_instanced, false);
   }
 
   // reload texture from another file if there is no texture loaded before
@@ -206,6 +387,14 @@ class Model : public Object {
   }
 
  private:
+  /*  Instance data  */
+  GLuint instanceVBO;     // The buffer of per-instance model matrices
+  GLuint num_instances;   // The number of placements in the buffer
+  GLuint lod_first[MAX_MESH_LODS], lod_count[MAX_MESH_LODS];  // The placements of each level
+
+  /*  Level of detail  */
+  GLuint lod;  // The level of `draw` and `drawDepth`
+
   /*  Functions  */
   // Loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
   void loadModel(std::string path) {
@@ -223,6 +412,10 @@ class Model : public Object {
     this->directory = path.substr(0, path.find_last_of('/'));
     // Process ASSIMP's root node recursively
     this->processNode(scene->mRootNode, scene);
+
+    // The bounds of the model contain the bounds of all meshes
+    for (GLuint i = 0; i < this->meshes.size(); i++)
+      Object::bounds = Object::bounds.merge(this->meshes[i].bounds);
   }
 
   // Processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -14,16 +14,25 @@
 #include <math.h>
 #include <time.h>
 
+#include <algorithm>
 #include <deque>
 #include <glm/glm.hpp>
 #include <iostream>
 #include <vector>
 
+#include "frustum.h"
+#include "gl_state.h"
+#include "primitives.h"
 #include "shader.hpp"
 #include "texture.h"
+#include "uniform_blocks.h"
 
 extern GLfloat deg2rad(const GLfloat& deg);
 
+/* Interned names of the uniforms set for every object (see main.frag)
+** The model matrix and the material coefficients are in the block `ObjectData` */
+static const UniformName uniform_material_diffuse("material.diffuse1");
+
 /* CLASS: Object (base class) */
 class Object {
  public:
@@ -31,7 +40,9 @@ class Object {
   Object(const GLfloat& _kd = 1.0f,
          const GLfloat& _ks = 0.0f,
          const GLfloat& _shininess = 10.0f)
-      : kd(_kd),
+      : VAO(0),
+        depthVAO(0),
+        kd(_kd),
         ks(_ks),
         shininess(_shininess) {
     if (kd + ks > 1.0) {
@@ -43,11 +54,60 @@ class Object {
 
   virtual void draw(Shader shader) = 0;
 
+  /* Draw @count instances in one call, the per-instance data comes from the
+  ** buffer attached with `setInstanceBuffer`. Objects supporting instancing override it. */
+  virtual void drawInstanced(Shader shader, const GLuint& count) {}
+
+  /* Draw the object into the shadow map
+  ** Only the positions are streamed (see `depthVAO`), no texture and no material. */
+  virtual void drawDepth(Shader shader) {
+    shader.install();
+    glState().bindVertexArray(depthVAO);
+    setObjectData(model2world);
+    drawGeometry(1);
+  }
+
+  /* Draw @count instances into the shadow map (see `drawInstanced`) */
+  virtual void drawDepthInstanced(Shader shader, const GLuint& count) {
+    shader.install();
+    glState().bindVertexArray(depthVAO);
+    setObjectData(instanceBase());
+    drawGeometry(count);
+  }
+
+  /* Attach a per-instance buffer to attribute @location (@size floats per instance)
+  ** The first instance is read at @offset (in bytes) of the buffer.
+  ** The buffer is attached to both VAOs (normal and depth-only). */
+  void setInstanceBuffer(const GLuint& location,
+                         const GLint& size,
+                         const GLuint& buffer,
+                         const GLsizeiptr& offset = 0) {
+    GLuint VAOs[] = {VAO, depthVAO};
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (GLuint i = 0; i < 2; ++i) {
+      if (VAOs[i] == 0) continue;
+      glState().bindVertexArray(VAOs[i]);
+      glEnableVertexAttribArray(location);
+      glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, size * sizeof(GLfloat), (GLvoid*)offset);
+      glVertexAttribDivisor(location, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
   GLfloat getKd() const { return kd; }
   GLfloat getKs() const { return ks; }
   GLfloat getShininess() const { return shininess; }
   glm::mat4 getModelMatrix() const { return model2world; }
   Texture* getTexture() const { return texture_ptr; }
+  GLuint getVAO() const { return VAO; }
+  GLuint getDepthVAO() const { return depthVAO; }
+
+  /* The bounding sphere in world space, placed by @model (default: the model matrix) */
+  BoundingSphere getBounds() const { return bounds.transform(model2world); }
+  BoundingSphere getBounds(const glm::mat4& model) const { return bounds.transform(model); }
+
+  /* The bounding sphere of an instance before its instance transform */
+  BoundingSphere getInstanceBounds() const { return bounds.transform(instanceBase()); }
   virtual void setModelMatrix(const glm::mat4& m) { model2world = m; }
   void setTexture(Texture* _texture) {
     if (!texture_ptr) texture_ptr = new Texture();
@@ -55,184 +115,153 @@ class Object {
   }
 
  protected:
+  /* Set the model matrix, the texture and the material of the object */
+  void setMaterial(Shader& shader, const glm::mat4& model) {
+    if (texture_ptr != NULL) {
+      texture_ptr->bind(texture_ptr->getUnit());
+      shader.setUniform1i(uniform_material_diffuse, texture_ptr->getUnit());
+    }
+    setObjectData(model);
+  }
+
+  /* Upload the model matrix and the material coefficients (block `ObjectData`) */
+  void setObjectData(const glm::mat4& model) {
+    ObjectData data;
+    data.model = model;
+    data.normalMatrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(model))));
+    data.kd = kd;
+    data.ks = ks;
+    data.shininess = shininess;
+    data.padding = 0.0f;
+    objectDataBuffer().update(data);
+  }
+
+  /* Issue the draw call of @count instances (the VAO is bound already) */
+  virtual void drawGeometry(const GLuint& count) {}
+
+  /* The model matrix applied before the instance transform */
+  virtual glm::mat4 instanceBase() const { return glm::mat4(); }
+
+  /* Create the depth-only VAO: attribute 0 (position, 3 floats) only, read from
+  ** @buffer with @stride. @EBO (if not 0) is attached too. */
+  void setupDepthVAO(const GLuint& buffer, const GLsizei& stride, const GLuint& EBO = 0) {
+    glGenVertexArrays(1, &depthVAO);
+    glState().bindVertexArray(depthVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+    if (EBO) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glState().bindVertexArray(0);
+  }
+
   GLuint VAO;             // vertex array object
+  GLuint depthVAO;        // vertex array object of the depth pass (positions only)
+  BoundingSphere bounds;  // the bounding sphere in model space, set up with the geometry
   glm::mat4 model2world;  // this matrix transforms the object from model space to world space
   Texture* texture_ptr;   // texture(s)
   GLfloat kd, ks, shininess;
 };
 
-static const GLfloat g_vertices_square[] = {
-    // Positions, Normals, Texture Coordinates
-    0.5f, 0.5f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f,    // Top Right
-    0.5f, -0.5f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f,   // Bottom Right
-    -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f,  // Bottom Left
-    -0.5f, 0.5f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f    // Top Left
-};
+/* CLASS: Primitive (base class of the procedural objects)
+** The geometry is shared by all objects of the same primitive (see `primitiveMesh`),
+** each object only owns its VAOs, which hold its own instance attributes. */
+class Primitive : public Object {
+ public:
+  /* Default constructor & Constructor */
+  Primitive(const GLfloat& _kd = 1.0f,
+            const GLfloat& _ks = 0.0f,
+            const GLfloat& _shininess = 10.0f)
+      : Object(_kd, _ks, _shininess),
+        mesh(NULL) {}
 
-static const GLuint g_indices_square[] = {
-    // Note that we start from 0!
-    0, 1, 3,  // First Triangle
-    1, 2, 3   // Second Triangle
-};
+  void draw(Shader shader) {
+    shader.install();
+    glState().bindVertexArray(VAO);
+    setMaterial(shader, model2world);
+    glDrawElements(GL_TRIANGLES, mesh->num_indices, GL_UNSIGNED_INT, 0);
+  }
 
-// this square's center is at (0,0,0), the length of each edge is 1
-// this square is at plane xOy
-class Square : public Object {
- public:
-  Square() {};
-  Square(const GLfloat& _kd, const GLfloat& _ks, const GLfloat& _shininess) : Object(_kd, _ks, _shininess) {}
+  /* draw @count instances, `instanceBase` is applied before the instance transform */
+  void drawInstanced(Shader shader, const GLuint& count) {
+    shader.install();
+    glState().bindVertexArray(VAO);
+    setMaterial(shader, instanceBase());
+    drawGeometry(count);
+  }
+
+ protected:
+  void drawGeometry(const GLuint& count) {
+    glDrawElementsInstanced(GL_TRIANGLES, mesh->num_indices, GL_UNSIGNED_INT, 0, count);
+  }
+
+  /* Use the geometry @_mesh: create the VAOs reading its buffers
+  ** The old VAOs (if any) are deleted, the instance buffers must be attached again. */
+  void setupPrimitive(const PrimitiveMesh& _mesh) {
+    if (VAO) glDeleteVertexArrays(1, &VAO);
+    if (depthVAO) glDeleteVertexArrays(1, &depthVAO);
+    mesh = &_mesh;
+    bounds = mesh->bounds;
 
-  void setup() {
-    GLuint VBO, EBO;
+    GLsizei stride = PRIMITIVE_VERTEX_SIZE * sizeof(GLfloat);
     glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertices_square), g_vertices_square, GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(g_indices_square), g_indices_square, GL_STATIC_DRAW);
+    glState().bindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->EBO);
     // link vertex attributes
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)0);
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(3 * sizeof(GLfloat)));
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(6 * sizeof(GLfloat)));
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    glState().bindVertexArray(0);
+    setupDepthVAO(mesh->VBO, stride, mesh->EBO);
   }
 
-  void draw(Shader shader) {
-    shader.install();
-    glBindVertexArray(VAO);
-    shader.setUniformMatrix4fv("model", model2world);
-    if (texture_ptr != NULL) {
-      texture_ptr->bind(texture_ptr->getUnit());
-      shader.setUniform1i("material.diffuse1", texture_ptr->getUnit());
-    }
-    shader.setUniform1f("material.kd", kd);
-    shader.setUniform1f("material.ks", ks);
-    shader.setUniform1f("material.shininess", shininess);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-    texture_ptr->unbind();
-    glBindVertexArray(0);
-    // Disable vertex attribute array
-    glDisableVertexAttribArray(2);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(0);
-    shader.uninstall();
-  }
+  /* The shared geometry (see `setupPrimitive`) */
+  const PrimitiveMesh* mesh;
 };
 
-static const GLfloat g_vertices_cube[] = {
-    // Back face
-    -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f,  // bottom-left
-    0.5f, 0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f,    // top-right
-    0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f,   // bottom-right
-    0.5f, 0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f,    // top-right
-    -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f,  // bottom-left
-    -0.5f, 0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f,   // top-left
-    // Front face
-    -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // bottom-left
-    0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f,   // bottom-right
-    0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f,    // top-right
-    0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f,    // top-right
-    -0.5f, 0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f,   // top-left
-    -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // bottom-left
-    // Left face
-    -0.5f, 0.5f, 0.5f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f,    // top-right
-    -0.5f, 0.5f, -0.5f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f,   // top-left
-    -0.5f, -0.5f, -0.5f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f,  // bottom-left
-    -0.5f, -0.5f, -0.5f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f,  // bottom-left
-    -0.5f, -0.5f, 0.5f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f,   // bottom-right
-    -0.5f, 0.5f, 0.5f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f,    // top-right
-    // Right face
-    0.5f, 0.5f, 0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,    // top-left
-    0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f,  // bottom-right
-    0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f,   // top-right
-    0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f,  // bottom-right
-    0.5f, 0.5f, 0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,    // top-left
-    0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f,   // bottom-left
-    // Bottom face
-    -0.5f, -0.5f, -0.5f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f,  // top-right
-    0.5f, -0.5f, -0.5f, 0.0f, -1.0f, 0.0f, 1.0f, 1.0f,   // top-left
-    0.5f, -0.5f, 0.5f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f,    // bottom-left
-    0.5f, -0.5f, 0.5f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f,    // bottom-left
-    -0.5f, -0.5f, 0.5f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f,   // bottom-right
-    -0.5f, -0.5f, -0.5f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f,  // top-right
-    // Top face
-    -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f,  // top-left
-    0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,    // bottom-right
-    0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f,   // top-right
-    0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,    // bottom-right
-    -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f,  // top-left
-    -0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f    // bottom-left
+// this square's center is at (0,0,0), the length of each edge is 1
+// this square is at plane xOy
+class Square : public Primitive {
+ public:
+  Square() {};
+  Square(const GLfloat& _kd, const GLfloat& _ks, const GLfloat& _shininess) : Primitive(_kd, _ks, _shininess) {}
+
+  void setup() { setupPrimitive(primitiveMesh(PRIMITIVE_QUAD)); }
 };
 
 // this cube's center is at (0,0,0), the length of each edge is 1
-class Cube : public Object {
+class Cube : public Primitive {
  public:
   Cube(const glm::mat4& m = glm::mat4()) {
     mat = m;
     model2world = mat;
   }
-  Cube(const GLfloat& _kd, const GLfloat& _ks, const GLfloat& _shininess, const glm::mat4& m = glm::mat4()) : Object(_kd, _ks, _shininess) {
+  Cube(const GLfloat& _kd, const GLfloat& _ks, const GLfloat& _shininess, const glm::mat4& m = glm::mat4()) : Primitive(_kd, _ks, _shininess) {
     mat = m;
     model2world = mat;
   }
-  void setup() {
-    GLuint VBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertices_cube), g_vertices_cube, GL_STATIC_DRAW);
-    // link vertex attributes
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), (GLvoid*)(6 * sizeof(GLfloat)));
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-  }
-
-  void draw(Shader shader) {
-    shader.install();
-    glBindVertexArray(VAO);
-    shader.setUniformMatrix4fv("model", model2world);
-    if (texture_ptr != NULL) {
-      texture_ptr->bind(texture_ptr->getUnit());
-      shader.setUniform1i("material.diffuse1", texture_ptr->getUnit());
-    }
-    shader.setUniform1f("material.kd", kd);
-    shader.setUniform1f("material.ks", ks);
-    shader.setUniform1f("material.shininess", shininess);
-    glDrawArrays(GL_TRIANGLES, 0, 36);  // 12 triangles
-    texture_ptr->unbind();
-    glBindVertexArray(0);
-    // Disable vertex attribute array
-    glDisableVertexAttribArray(2);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(0);
-    shader.uninstall();
-  }
+  void setup() { setupPrimitive(primitiveMesh(PRIMITIVE_CUBE)); }
 
   void setModelMatrix(const glm::mat4& m) { model2world = m * mat; }
 
   void setInitModelMatrix(const glm::mat4& m) { mat = m; }
 
+ protected:
+  glm::mat4 instanceBase() const { return mat; }
+
  private:
   glm::mat4 mat;
 };
 
-/* CLASS: Ball */
-class Ball : public Object {
+/* CLASS: Ball
+** The geometry is the sphere of radius 1 (shared by the balls with the same slices and
+** stacks), @radius is applied by the model matrix (see `renderScene`). */
+class Ball : public Primitive {
  public:
   /* Default constructor */
   Ball(GLfloat _radius = 1.0f,
@@ -241,48 +270,17 @@ class Ball : public Object {
        GLfloat _kd = 1.0f,
        GLfloat _ks = 0.0f,
        GLfloat _shininess = 0.0f)
-      : Object(_kd, _ks, _shininess),
+      : Primitive(_kd, _ks, _shininess),
         radius(_radius),
         slices(_slices),
-        stacks(_stacks) {
-    genVertCord();
-    genUVCord();
-  }
+        stacks(_stacks) {}
 
   /* Bind vertex data buffers
   ** Must run this function before drawing
   ** ATTENTION:
   **      You must initialize GLEW before calling this function!
   **      In other words, call this function after `GlewInit()`. */
-  void setup() {
-    // Generate vertex arrays and buffers
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &vert_VBO);
-    glGenBuffers(1, &normal_VBO);
-    glGenBuffers(1, &uv_VBO);
-
-    // Bind buffer data (@vert_VBO and @uv_VBO)
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, vert_VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertex.size() * sizeof(GLfloat), vertex.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, normal_VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertex.size() * sizeof(GLfloat), vertex.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, uv_VBO);
-    glBufferData(GL_ARRAY_BUFFER, uvcord.size() * sizeof(GLfloat), uvcord.data(), GL_STATIC_DRAW);
-    // Set the vertex attribute pointers
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-
-    // Bind buffer data: @vert_VBO, @normal_VBO and @uv_VBO
-    glBindBuffer(GL_ARRAY_BUFFER, vert_VBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-    glBindBuffer(GL_ARRAY_BUFFER, normal_VBO);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-    glBindBuffer(GL_ARRAY_BUFFER, uv_VBO);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-    glBindVertexArray(0);
-  }
+  void setup() { setupPrimitive(primitiveMesh(PRIMITIVE_SPHERE, slices, stacks)); }
 
   /* Return private members
   ** Read the value of the @radius, @slices and @stacks */
@@ -291,21 +289,15 @@ class Ball : public Object {
   const GLint getStacks() { return stacks; }
 
   /* Reset some private members
-  ** Regenerate the coordinates of vertices if you reset these members */
-  void setRadius(const GLfloat _radius) {
-    radius = _radius;
-    genVertCord();
-    genUVCord();
-  }
+  ** The geometry is set up again if the tessellation changes after `setup` */
+  void setRadius(const GLfloat _radius) { radius = _radius; }
   void setSlices(const GLint _slices) {
     slices = _slices;
-    genVertCord();
-    genUVCord();
+    if (mesh) setup();
   }
   void setStacks(const GLint _stacks) {
     stacks = _stacks;
-    genVertCord();
-    genUVCord();
+    if (mesh) setup();
   }
 
   /* Reset all private members */
@@ -315,79 +307,10 @@ class Ball : public Object {
     radius = _radius;
     slices = _slices;
     stacks = _stacks;
-    genVertCord();
-    genUVCord();
-  }
-
-  /* draw the ball (DEFAULT) */
-  void draw(Shader shader) {
-    shader.install();
-    glBindVertexArray(VAO);
-    shader.setUniformMatrix4fv("model", model2world);
-    if (texture_ptr != NULL) {
-      texture_ptr->bind(texture_ptr->getUnit());
-      shader.setUniform1i("material.diffuse1", texture_ptr->getUnit());
-    }
-    shader.setUniform1f("material.kd", kd);
-    shader.setUniform1f("material.ks", ks);
-    shader.setUniform1f("material.shininess", shininess);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, (slices + 1) * stacks * 2);
-    texture_ptr->unbind();
-    glBindVertexArray(0);
-    // Disable vertex attribute array
-    glDisableVertexAttribArray(2);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(0);
-    shader.uninstall();
+    if (mesh) setup();
   }
 
  protected:
-  /* PRIVATE MEMBER:
-  ** Generate vertex coordinates */
-  void genVertCord() {
-    // A fragment is determined by its two endpoints (6 coordinates)
-    // The number of vertices is determined by @slices and @stacks
-    vertex.reserve((slices + 1) * stacks * 6);
-
-    // Calculate the coordinates
-    for (int i = 0; i < stacks; i++) {
-      // The current and the next latitude (TOTAL: @stacks)
-      GLfloat cur_latitude = M_PI * (-0.5f + (GLfloat)i / stacks);
-      GLfloat next_latitude = M_PI * (-0.5f + (GLfloat)(i + 1) / stacks);
-
-      for (int j = 0; j < slices + 1; j++) {
-        // The current longitude
-        GLfloat longitude = 2.0f * M_PI * (GLfloat)j / slices;
-
-        // The start point of the current fragment
-        vertex.push_back(radius * cos(cur_latitude) * sin(longitude));
-        vertex.push_back(radius * sin(cur_latitude));
-        vertex.push_back(radius * cos(cur_latitude) * cos(longitude));
-
-        // The end point of the current fragment
-        vertex.push_back(radius * cos(next_latitude) * sin(longitude));
-        vertex.push_back(radius * sin(next_latitude));
-        vertex.push_back(radius * cos(next_latitude) * cos(longitude));
-      }
-    }
-  }
-
-  /* PRIVATE MEMBER:
-  ** Generate UV coordinates */
-  void genUVCord() {
-    // Notice that the texture image is 2D
-    // Each fragment need two 20-points (4 coordinates)
-    uvcord.reserve((slices + 1) * stacks * 4);
-    for (int i = 0; i < stacks; i++) {
-      for (int j = 0; j < slices + 1; j++) {
-        uvcord.push_back((GLfloat)j * 1.0f / slices);
-        uvcord.push_back((GLfloat)i * 1.0f / stacks);
-        uvcord.push_back((GLfloat)j * 1.0f / slices);
-        uvcord.push_back((GLfloat)(i + 1) * 1.0f / stacks);
-      }
-    }
-  }
-
   /* The radius of the ball
   ** Actually in function `glutSolidSphere (glutWireSphere)`
   ** ATTENTION: The type of RADIUS is `GLdouble` */
@@ -400,15 +323,6 @@ class Ball : public Object {
 
   /* The number of subdivisions along the Z axis (similar to lines of latitude). */
   GLint stacks;
-
-  /* The vertex coordinates and UV coordinates vector.
-  ** Used when drawing this ball.
-  ** We use std::vector<> instead of glm::vec3, because we need to bind
-  ** vertex buffer with array. `.data()` in std::vector<> provided.*/
-  std::vector<GLfloat> vertex, uvcord;
-
-  /* The VBOs of this ball */
-  GLuint vert_VBO, uv_VBO, normal_VBO;
 };
 
 /* CLASS: Snow ball - Our protagonist! */
@@ -506,6 +420,18 @@ class SnowBall : public Ball {
 /* Queue structure of barriers' position */
 typedef std::deque<int> barrierDeque;
 
+/* STRUCT: The per-instance data of a barrier
+** @param lane: The x coordinate of the lane
+** @param z: The z coordinate of the row
+** @param phase: The rotation angle (around y) when the row was created
+** The rotation is animated in the vertex shader: `phase + time * barrierSpin` */
+struct BarrierInstance {
+  GLfloat lane, z, phase;
+};
+
+/* The attribute location of the barrier instance data (see main.vert) */
+const GLuint barrier_instance_location = 9;
+
 /* CLASS: barriers */
 class Barriers {
  public:
@@ -520,9 +446,16 @@ class Barriers {
            GLuint _num_barrier_types = 1)
       : baseline(_baseline),
         rotSpeed(_rotSpeed),
+        spinSpeed(1.0f),
         spacing(_spacing),
         rowSize(_rowSize),
-        num_barrier_types(_num_barrier_types) {
+        num_barrier_types(_num_barrier_types),
+        view_z(0.0f),
+        view_radius(-1.0f),
+        view_frustum(NULL),
+        num_drawn(0),
+        num_culled(0),
+        dirty(true) {
     // Default settings
     // for (GLuint i = 0; i < 2 * rowSize; ++i) {
     //  barrier_types.push_back(0);
@@ -551,6 +484,20 @@ class Barriers {
   /* Modify the value of private members */
   void setBaseline(const GLfloat _baseline) { baseline = _baseline; }
   void setSpacing(const GLfloat _spacing) { spacing = _spacing; }
+  void setSpinSpeed(const GLfloat _spinSpeed) { spinSpeed = _spinSpeed; }
+
+  /* Only draw the rows within @radius of @z (a negative radius draws all rows) */
+  void setView(const GLfloat& z, const GLfloat& radius) {
+    view_z = z;
+    view_radius = radius;
+  }
+
+  /* Also skip the barriers outside @frustum at both ends of the rows (NULL: none) */
+  void setFrustum(const Frustum* frustum) { view_frustum = frustum; }
+
+  /* The number of barriers drawn and skipped by the last draw */
+  const GLuint getNumDrawn() { return num_drawn; }
+  const GLuint getNumCulled() { return num_culled; }
 
   /* Notice that the value of @rotAngle is [0.0f, 360.0f) */
   void setRotSpeed(const GLfloat _rotSpeed) {
@@ -571,6 +518,7 @@ class Barriers {
     for (int i = 0; i < 2 * rowSize; ++i) {
       barrier_types[i] = rand() % num_barrier_types;
     }
+    dirty = true;
   }
 
   /* DEFAULT: Initialize the barrier queue */
@@ -597,19 +545,11 @@ class Barriers {
 
     GLfloat barrierLoop = -spacing;
     barrierDeque::iterator iter = deque.begin();
-    glm::mat4 model;
     for (; iter != deque.end(); iter++) {
       for (int pos = -1; pos < 2; pos++) {
         if (*iter != pos) {
           // Draw barrier at each unsafe position
-          model = glm::translate(glm::mat4(), glm::vec3(pos * 3.0f, 0.0f, barrierLoop));
-          model = glm::translate(model, glm::vec3(0.0f, baseline, 0.0f));
-#ifdef _WIN32
-          model = glm::rotate(model, deg2rad(rotSpeed), glm::vec3(0.0f, 1.0f, 0.0f));
-#else
-          model = glm::rotate(model, rotSpeed, glm::vec3(0.0f, 1.0f, 0.0f));
-#endif
-          model2worlds.push_back(model);
+          instances.push_back(newInstance(pos, barrierLoop));
         }
       }
       barrierLoop -= spacing;
@@ -647,22 +587,15 @@ class Barriers {
     barrier_types.pop_front();
     barrier_types.push_back(type1);
 
-    glm::mat4 model;
     for (GLint i = -1; i < 2; ++i) {
       if (i != safeLane) {
-        model = glm::translate(glm::mat4(), glm::vec3(i * 3.0f, 0.0f, begin_z - spacing * rowSize));
-        model = glm::translate(model, glm::vec3(0.0f, baseline, 0.0f));
-#ifdef _WIN32
-        model = glm::rotate(model, deg2rad(rotSpeed), glm::vec3(0.0f, 1.0f, 0.0f));
-#else
-        model = glm::rotate(model, rotSpeed, glm::vec3(0.0f, 1.0f, 0.0f));
-#endif
-        model2worlds.pop_front();
-        model2worlds.push_back(model);
+        instances.pop_front();
+        instances.push_back(newInstance(i, begin_z - spacing * rowSize));
       }
     }
 
     begin_z -= spacing;
+    dirty = true;
   }
 
   /* Output the deque data to the console */
@@ -674,27 +607,30 @@ class Barriers {
     std::print("\n");
   }
 
-  void draw(Shader shader) {
-    for (int i = 0; i < 2 * rowSize; ++i) {
-      barrier_objs[barrier_types[i]]->setModelMatrix(model2worlds[i]);
-      barrier_objs[barrier_types[i]]->draw(shader);
-    }
-  }
+  /* Draw the barriers, one instanced draw call per barrier type
+  ** The rotation is animated in the shader from the uniform `time` */
+  void draw(Shader shader) { drawTypes(shader, false); }
 
-  void setModelMatrix(const GLuint& i, const glm::mat4& mat) {
-    if (i < model2worlds.size()) {
-      model2worlds[i] = mat;
-    }
-  }
+  /* Draw the barriers into the shadow map (positions only, see `Object::drawDepth`) */
+  void drawDepth(Shader shader) { drawTypes(shader, true); }
 
   void setBarrierType(const GLuint& i, const GLuint& t) {
     if (i < barrier_types.size()) {
       barrier_types[i] = t;
+      dirty = true;
     }
   }
 
+  /* Set the object of barrier type @i
+  ** ATTENTION: Call it after the object is set up (it creates the instance buffer) */
   void setBarrierObj(const GLuint& i, Object& obj) {
     barrier_objs[i] = &obj;
+    if (type_VBOs.size() < barrier_objs.size())
+      type_VBOs.resize(barrier_objs.size(), 0);
+    if (type_VBOs[i] == 0)
+      glGenBuffers(1, &type_VBOs[i]);
+    obj.setInstanceBuffer(barrier_instance_location, 3, type_VBOs[i]);
+    dirty = true;
   }
 
  private:
@@ -707,6 +643,9 @@ class Barriers {
   ** The value of rotation angle is [0.0f, 360.0f) */
   GLfloat rotSpeed;
 
+  /* The angular speed (radians per second) of the barriers' rotation */
+  GLfloat spinSpeed;
+
   /* The spacing between two barrier rows */
   GLfloat spacing;
 
@@ -716,10 +655,9 @@ class Barriers {
   /* Barriers' position dequeue */
   barrierDeque deque;
 
-  /* Model matrices for barriers
-  ** Size of this vector equals 2 * rowSize */
-  // std::vector<glm::mat4> model2worlds;
-  std::deque<glm::mat4> model2worlds;
+  /* Instance data for barriers
+  ** Size of this deque equals 2 * rowSize */
+  std::deque<BarrierInstance> instances;
 
   /* Barrier types
   ** example: 0 for ball, 1 for cube */
@@ -733,6 +671,102 @@ class Barriers {
   std::vector<Object*> barrier_objs;
 
   GLfloat begin_z;
+
+  /* The rows drawn: within @view_radius of @view_z (see `setView`), and inside
+  ** @view_frustum (see `setFrustum`) */
+  GLfloat view_z, view_radius;
+  const Frustum* view_frustum;
+
+  /* The number of barriers drawn and skipped by the last draw */
+  GLuint num_drawn, num_culled;
+
+  /* The instance data grouped by barrier type, and their buffers
+  ** @dirty: whether the groups must be rebuilt and uploaded before drawing */
+  std::vector<std::vector<BarrierInstance> > type_instances;
+  std::vector<GLuint> type_VBOs;
+  GLboolean dirty;
+
+  /* PRIVATE MEMBER: The instance of a new barrier at @lane (-1, 0, 1) of row @z */
+  BarrierInstance newInstance(const GLint& lane, const GLfloat& z) {
+    BarrierInstance instance;
+    instance.lane = lane * 3.0f;
+    instance.z = z;
+#ifdef _WIN32
+    instance.phase = deg2rad(rotSpeed);
+#else
+    instance.phase = rotSpeed;
+#endif
+    return instance;
+  }
+
+  /* PRIVATE MEMBER: The center of the barrier @instance (world space) */
+  glm::vec3 instanceCenter(const BarrierInstance& instance) const {
+    return glm::vec3(instance.lane, baseline, instance.z);
+  }
+
+  /* PRIVATE MEMBER: Comparator for searching the rows sorted by decreasing z */
+  static bool instanceAbove(const BarrierInstance& instance, const GLfloat& z) {
+    return instance.z > z;
+  }
+
+  /* PRIVATE MEMBER
+  ** Draw the visible rows of every barrier type (@depth: into the shadow map) */
+  void drawTypes(Shader& shader, const GLboolean& depth) {
+    if (dirty) upload();
+    num_drawn = num_culled = 0;
+
+    shader.install();
+    shader.setUniform1i("barrierInstanced", true);
+    shader.setUniform1f("barrierBaseline", baseline);
+    shader.setUniform1f("barrierSpin", spinSpeed);
+    for (GLuint t = 0; t < num_barrier_types; ++t) {
+      if (!barrier_objs[t]) continue;
+
+      // The rows are sorted by z (decreasing), so the visible rows are a range
+      const std::vector<BarrierInstance>& group = type_instances[t];
+      GLuint first = 0, last = group.size();
+      if (view_radius >= 0.0f) {
+        first = std::lower_bound(group.begin(), group.end(), view_z + view_radius, instanceAbove) - group.begin();
+        last = std::lower_bound(group.begin(), group.end(), view_z - view_radius, instanceAbove) - group.begin();
+      }
+
+      // Trim the barriers outside the frustum at both ends of the range
+      // The instance spins around its y axis, so its sphere is centered there
+      BoundingSphere local = barrier_objs[t]->getInstanceBounds();
+      if (view_frustum && local.radius >= 0.0f) {
+        GLfloat radius = glm::length(local.center) + local.radius;
+        while (first < last && !view_frustum->containsSphere(instanceCenter(group[first]), radius)) first++;
+        while (last > first && !view_frustum->containsSphere(instanceCenter(group[last - 1]), radius)) last--;
+      }
+      num_drawn += last > first ? last - first : 0;
+      num_culled += group.size() - (last > first ? last - first : 0);
+      if (first >= last) continue;
+
+      // Point the instance attribute at the first visible barrier
+      barrier_objs[t]->setInstanceBuffer(barrier_instance_location, 3, type_VBOs[t],
+                                         first * sizeof(BarrierInstance));
+      if (depth)
+        barrier_objs[t]->drawDepthInstanced(shader, last - first);
+      else
+        barrier_objs[t]->drawInstanced(shader, last - first);
+    }
+    shader.setUniform1i("barrierInstanced", false);
+  }
+
+  /* PRIVATE MEMBER: Group the instances by type and upload them */
+  void upload() {
+    type_instances.assign(num_barrier_types, std::vector<BarrierInstance>());
+    for (GLuint i = 0; i < instances.size(); ++i)
+      type_instances[barrier_types[i]].push_back(instances[i]);
+
+    for (GLuint t = 0; t < num_barrier_types && t < type_VBOs.size(); ++t) {
+      glBindBuffer(GL_ARRAY_BUFFER, type_VBOs[t]);
+      glBufferData(GL_ARRAY_BUFFER, type_instances[t].size() * sizeof(BarrierInstance),
+                   type_instances[t].data(), GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    dirty = false;
+  }
 };
 
 #endif
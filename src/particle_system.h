@@ -17,18 +17,24 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/gtx/norm.hpp>
+#include <functional>
 #include <iostream>
+#include <random>
 #include <vector>
 
 #include "camera.h"
+#include "frustum.h"
+#include "gl_state.h"
 #include "shader.hpp"
 #include "texture.h"
 
-#define RANDOM_MIN_MAX(min, max) (min + ((float)rand() / (float)RAND_MAX) * (max - min))
-
 extern GLfloat offset_z;
 
+/* The function type which returns the ground height at given x-z (world) coordinates */
+typedef std::function<GLfloat(const GLfloat&, const GLfloat&)> GroundHeightFunc;
+
 /* STRUCT: Particle base */
 struct ParticleBase {
   /* Default constructor & Constructor */
@@ -47,6 +53,21 @@ struct ParticleBase {
   GLfloat size;
 };
 
+/* STRUCT: Packed per-instance attributes of a particle
+** This is exactly what we upload for each living particle every frame (10 bytes).
+** @param offset: The position relative to the origin of the system (half floats)
+** @param size: The size of particle, normalized by the max size of the system
+** @param rotation: The rotation angle of the quad, normalized by 2 * PI
+** @param fade: The alpha factor computed from the remaining life (fades in the last quarter)
+** Unpacked into floats the same data would cost 24 bytes per instance. */
+struct ParticleInstance {
+  GLhalf offset[3];
+  GLubyte size;
+  GLubyte rotation;
+  GLubyte fade;
+  GLubyte padding;
+};
+
 /* STRUCT: Particle structure */
 class Particle : public ParticleBase {
  public:
@@ -57,10 +78,16 @@ class Particle : public ParticleBase {
            const glm::vec3& _velocity = glm::vec3(0.0f, 0.0f, 0.0f))
       : ParticleBase(_drag_coef, _size),
         position(_position),
+        last_position(_position),
         velocity(_velocity),
         gravity(glm::vec3(0.0f, -9.80665f, 0.0f)),
         drag(glm::vec3(0.0f, 0.0f, 0.0f)),
-        life(-1.0f) {  // Do nothing here
+        rotation(0.0f),
+        spin(0.0f),
+        life(-1.0f),
+        period(1.0f),
+        lod_rank(0.0f),
+        emitter(0) {  // Do nothing here
   }
 
   /*****************
@@ -82,9 +109,10 @@ class Particle : public ParticleBase {
       drag = -drag_acc * glm::normalize(velocity);
   }
 
-  /* PUBLIC MEMBER
-  ** The position of particle */
-  glm::vec3 position;
+  /* PUBLIC MEMBERS
+  ** @param position: The position of particle
+  ** @param last_position: The position of particle before the last step (for interpolation) */
+  glm::vec3 position, last_position;
 
   /* PUBLIC MEMBER
   ** The velocity of particle */
@@ -98,30 +126,133 @@ class Particle : public ParticleBase {
   const glm::vec3 gravity;
   glm::vec3 drag;
 
+  /* PUBLIC MEMBERS
+  ** @param rotation: The rotation angle of the snowflake quad (radian)
+  ** @param spin: The angular speed of the snowflake (radian per second) */
+  GLfloat rotation, spin;
+
+  /* PUBLIC MEMBERS
+  ** @param life: remaining life of the particle. if < 0 : dead and unused.
+  ** @param period: the whole life of the particle (used to compute the fade) */
+  GLfloat life, period;
+
+  /* PUBLIC MEMBER
+  ** A random number in [0, 1) fixed at respawn. The particle is drawn only if its
+  ** rank is below the density at its distance, so thinning is stable per particle. */
+  GLfloat lod_rank;
+
   /* PUBLIC MEMBER
-  ** remaining life of the particle. if < 0 : dead and unused. */
-  GLfloat life;
+  ** The index of the emitter which spawned this particle */
+  GLuint emitter;
 };
 
-/* CLASS: Particle system */
-class ParticleSystem : public ParticleBase {
- public:
+/* STRUCT: Particle emitter
+** An emitter only describes how particles are spawned. All emitters allocate their
+** particles from the pool of one `ParticleSystem`, so adding an emitter adds neither
+** a draw call nor a buffer. */
+struct ParticleEmitter : public ParticleBase {
   /* Default constructor & Constructor */
-  ParticleSystem(const Shader& _shader,
-                 const Texture& _texture,
-                 const glm::vec3& _position_generator,
-                 GLuint _generate_speed,
-                 GLfloat _range_x,
-                 GLfloat _range_z,
-                 GLfloat _drag_coef = 200.0f,
-                 GLfloat _size = 0.2f)
+  ParticleEmitter(GLuint _group = 0,
+                  const glm::vec3& _position = glm::vec3(0.0f, 0.0f, 0.0f),
+                  GLfloat _generate_speed = 0.0f,
+                  GLfloat _period = 1.0f,
+                  const glm::vec3& _range_min = glm::vec3(0.0f, 0.0f, 0.0f),
+                  const glm::vec3& _range_max = glm::vec3(0.0f, 0.0f, 0.0f),
+                  const glm::vec3& _velocity_min = glm::vec3(0.0f, 0.0f, 0.0f),
+                  const glm::vec3& _velocity_max = glm::vec3(0.0f, 0.0f, 0.0f),
+                  GLfloat _drag_coef = 200.0f,
+                  GLfloat _size = 0.2f)
       : ParticleBase(_drag_coef, _size),
-        shader(_shader),
-        texture(_texture),
+        group(_group),
+        position(_position),
         generate_speed(_generate_speed),
-        position_generator(_position_generator),
-        range_x(_range_x),
-        range_z(_range_z) {  // Do initialization
+        period(_period),
+        spawn_carry(0.0f),
+        range_min(_range_min),
+        range_max(_range_max),
+        velocity_min(_velocity_min),
+        velocity_max(_velocity_max),
+        active(true),
+        follow(false) {  // Do nothing here
+  }
+
+  /* PUBLIC MEMBER
+  ** The render group (texture and blend mode) of the spawned particles */
+  GLuint group;
+
+  /* PUBLIC MEMBER
+  ** The position of the emitter */
+  glm::vec3 position;
+
+  /* PUBLIC MEMBERS
+  ** @param generate_speed: The number of new particles generated for a second
+  **     (zero means the emitter only spawns particles by bursts)
+  ** @param period: The life of the spawned particles */
+  GLfloat generate_speed, period;
+
+  /* PUBLIC MEMBER
+  ** The fractional number of particles not spawned yet (carried between steps) */
+  GLfloat spawn_carry;
+
+  /* PUBLIC MEMBERS
+  ** The box (relative to @position) within which we respawn particles */
+  glm::vec3 range_min, range_max;
+
+  /* PUBLIC MEMBERS
+  ** The range of the initial velocity of spawned particles */
+  glm::vec3 velocity_min, velocity_max;
+
+  /* PUBLIC MEMBERS
+  ** @param active: Whether the emitter spawns particles continuously
+  ** @param follow: Whether the spawned particles move with the player (see `offset_z`) */
+  GLboolean active, follow;
+};
+
+/* STRUCT: Particle render group
+** Particles of all emitters sharing a texture and a blend mode are drawn together. */
+struct ParticleGroup {
+  /* Default constructor & Constructor */
+  ParticleGroup(const Texture& _texture,
+                GLenum _blend_dst = GL_ONE)
+      : texture(_texture),
+        blend_dst(_blend_dst) {  // Do nothing here
+  }
+
+  /* PUBLIC MEMBER
+  ** The texture we use to attach to each particle of this group */
+  Texture texture;
+
+  /* PUBLIC MEMBER
+  ** The destination blend factor (the source factor is always GL_SRC_ALPHA)
+  ** GL_ONE for additive blending, GL_ONE_MINUS_SRC_ALPHA for alpha blending */
+  GLenum blend_dst;
+
+  /* PUBLIC MEMBER
+  ** Packed attributes of living particles in this group (updated every frame) */
+  std::vector<ParticleInstance> instances;
+};
+
+/* CLASS: Particle system
+** The pooled backend of all particle emitters. It owns the particles, a single
+** instance buffer and a single VAO, and draws one instanced call per group. */
+class ParticleSystem {
+ public:
+  /* Default constructor & Constructor */
+  ParticleSystem(const Shader& _shader,
+                 GLuint _total_num = 8192)
+      : shader(_shader),
+        total_num(_total_num),
+        origin(glm::vec3(0.0f, 0.0f, 0.0f)),
+        max_size(0.5f),
+        record_impacts(false),
+        eye(glm::vec3(0.0f, 0.0f, 0.0f)),
+        lod_near(20.0f),
+        lod_far(100.0f),
+        lod_min_density(0.25f),
+        culling(false),
+        time_step(1.0f / 60.0f),
+        max_steps(8),
+        accumulator(0.0f) {  // Do initialization
     init();
   }
 
@@ -129,118 +260,199 @@ class ParticleSystem : public ParticleBase {
   ** We set the particle system settings private, because they are not supposed to be
   ** editted easily. If they need to be editted, call the `set*` functions, which makes
   ** sure you edit them on purpose, instead of unconsciously. */
-  const GLfloat getTotalNum() { return total_num; }
-  const GLfloat getGenSpeed() { return generate_speed; }
-  const GLuint getRangeX() { return range_x; }
-  const GLuint getRangeZ() { return range_z; }
-  const GLfloat getPeriod() { return period; }
+  const GLuint getTotalNum() { return total_num; }
+  const GLuint getLiveNum() { return total_num_live; }
+  const GLuint getDrawNum() { return total_num_draw; }
+  const GLfloat getMaxSize() { return max_size; }
+  const GLfloat getTimeStep() { return time_step; }
+  const glm::vec3 getOrigin() { return origin; }
+  ParticleEmitter& getEmitter(const GLuint& i) { return emitters[i]; }
+  const std::vector<glm::vec3>& getImpacts() { return impacts; }
 
   /* Set some private numbers */
-  void setGenSpeed(const GLfloat _generate_speed) { generate_speed = _generate_speed; }
-  void setRangeX(const GLfloat _range_x) { range_x = _range_x; }
-  void setRangeZ(const GLfloat _range_z) { range_z = _range_z; }
-  void setGeneratorPos(const glm::vec3& pos) { position_generator = pos; }
+  void setTimeStep(const GLfloat _time_step) { time_step = _time_step; }
+  void setSeed(const GLuint& seed) { generator.seed(seed); }
+  void setMaxSize(const GLfloat _max_size) { max_size = _max_size; }
+  void setOrigin(const glm::vec3& _origin) { origin = _origin; }
+
+  /* Enable collision with the ground
+  ** Particles are retired as soon as they reach the height returned by @_ground.
+  ** If @_record_impacts is true, the impact points of the last update are kept
+  ** (see `getImpacts`). Pass an empty function to disable collision. */
+  void setGround(const GroundHeightFunc& _ground, GLboolean _record_impacts = false) {
+    ground = _ground;
+    record_impacts = _record_impacts;
+    impacts.clear();
+  }
+
+  /* Set the view used to cull particles in the next update
+  ** @param _frustum: The frustum of the camera
+  ** @param _eye: The position of the camera (for distance LOD) */
+  void setView(const Frustum& _frustum, const glm::vec3& _eye) {
+    frustum = _frustum;
+    eye = _eye;
+    culling = true;
+  }
+
+  /* Set the distance LOD
+  ** The density is 1 within @_near, and falls linearly to @_min_density at @_far. */
+  void setLOD(GLfloat _near, GLfloat _far, GLfloat _min_density) {
+    lod_near = _near;
+    lod_far = _far;
+    lod_min_density = _min_density;
+  }
+
+  /* Add a render group and return its index
+  ** Particles are grouped by texture and blend mode. */
+  GLuint addGroup(const Texture& texture, GLenum blend_dst = GL_ONE) {
+    groups.push_back(ParticleGroup(texture, blend_dst));
+    groups.back().instances.reserve(total_num);
+    return groups.size() - 1;
+  }
+
+  /* Add an emitter and return its index */
+  GLuint addEmitter(const ParticleEmitter& emitter) {
+    emitters.push_back(emitter);
+    return emitters.size() - 1;
+  }
+
+  /* Spawn @num particles from the given emitter at once */
+  void burst(const GLuint& emitter, GLuint num) {
+    for (GLuint i = 0; i < num; ++i)
+      respawn(particles[getfirstDeadParticle()], emitter);
+  }
 
   /* This function does UPDATE operations
-  ** @param dt: the time passed (between 2 frames) */
+  ** @param dt: the time passed (between 2 frames)
+  ** The particles are stepped at the fixed rate @time_step with an accumulator, so the
+  ** simulation (and the snow density) does not depend on the frame rate. Positions are
+  ** interpolated between the last two steps for rendering. */
   void update(const GLfloat& dt) {
-    // Count the number of living particles after dt
-    GLuint count = 0;
-    GLuint num_new_particles = dt * generate_speed;
-
-    // Create new particles
-    for (GLuint i = 0; i < num_new_particles; ++i) {
-      GLuint unusedParticle = getfirstDeadParticle();
-      respawn(particles[unusedParticle]);
+    // Clear the impacts of the last update
+    impacts.clear();
+
+    // Run as many fixed steps as the accumulated time allows
+    // Drop the remaining time if the frame was too long, or we would never catch up
+    accumulator += dt;
+    GLuint steps = 0;
+    while (accumulator >= time_step && steps < max_steps) {
+      step(time_step);
+      accumulator -= time_step;
+      steps++;
     }
-    // update all particles
+    if (accumulator >= time_step)
+      accumulator = 0.0f;
+
+    // Clear the instance data of all groups
+    for (GLuint g = 0; g < groups.size(); ++g)
+      groups[g].instances.clear();
+
+    // Count the number of living and visible particles
+    GLuint count = 0, count_draw = 0;
+
+    // The interpolation factor between the last two steps
+    GLfloat alpha = accumulator / time_step;
     for (GLuint i = 0; i < total_num; i++) {
-      // For each particle, decrease life
       Particle& particle = particles[i];
-      particle.life -= dt;
-
-      // Update particles if the chosen particle is still alive
-      if (particle.life > 0.0f) {
-        // Compute drag of the current particle
-        particle.updateDrag();
-
-        // Use the mechanical model!
-        particle.velocity += (particle.gravity + particle.drag) * dt;
-        particle.position += particle.velocity * dt + glm::vec3(0, 0, -offset_z);
-        ;
-        // Fill our particle_position_data
-        particle_position_data[3 * count + 0] = particle.position.x;
-        particle_position_data[3 * count + 1] = particle.position.y;
-        particle_position_data[3 * count + 2] = particle.position.z;
-        count++;
+      if (particle.life <= 0.0f) continue;
+
+      // Particles following the player are moved once per frame
+      if (emitters[particle.emitter].follow) {
+        particle.position.z -= offset_z;
+        particle.last_position.z -= offset_z;
       }
+      count++;
+
+      // Fill the instance data of its group (only if the particle can be seen)
+      glm::vec3 position = glm::mix(particle.last_position, particle.position, alpha);
+      if (!isVisible(particle, position)) continue;
+      GLfloat rotation = particle.rotation - (1.0f - alpha) * particle.spin * time_step;
+      ParticleGroup& group = groups[emitters[particle.emitter].group];
+      group.instances.push_back(ParticleInstance());
+      pack(particle, position, rotation, group.instances.back());
+      count_draw++;
     }
-    // Update the number of alive particles
+    // Update the number of alive and visible particles
     total_num_live = count;
+    total_num_draw = count_draw;
   }
 
-  void draw(Camera camera, GLuint texture_unit) {
+  void draw(Camera camera) {
+    if (total_num_draw == 0) return;
     shader.install();
-    glBindVertexArray(VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_position);
-    glBufferData(GL_ARRAY_BUFFER, total_num * 3 * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, total_num_live * 3 * sizeof(GLfloat), particle_position_data);
+    glState().bindVertexArray(VAO);
+
+    // Orphan the buffer and upload the groups one after another
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_instance);
+    glBufferData(GL_ARRAY_BUFFER, total_num * sizeof(ParticleInstance), NULL, GL_STREAM_DRAW);
+    GLuint first = 0;
+    for (GLuint g = 0; g < groups.size(); ++g) {
+      std::vector<ParticleInstance>& instances = groups[g].instances;
+      glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(ParticleInstance),
+                      instances.size() * sizeof(ParticleInstance), instances.data());
+      first += instances.size();
+    }
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    texture.bind(texture_unit);
-    shader.setUniform1i("texture_sampler", texture_unit);
+    glState().enable(GL_BLEND);
     glm::mat4 view = camera.getViewMat();
     shader.setUniform3f("CameraRight_worldspace", glm::vec3(view[0][0], view[1][0], view[2][0]));
     shader.setUniform3f("CameraUp_worldspace", glm::vec3(view[0][1], view[1][1], view[2][1]));
-    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, total_num_live);
-
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glDisable(GL_BLEND);
-    glBindVertexArray(0);
-    shader.uninstall();
+    shader.setUniform3f("emitter_position", origin);
+    shader.setUniform1f("max_size", max_size);
+
+    // One instanced draw call per group
+    // Instance attributes are re-pointed at the start of the group in the shared buffer
+    first = 0;
+    for (GLuint g = 0; g < groups.size(); ++g) {
+      ParticleGroup& group = groups[g];
+      if (group.instances.empty()) continue;
+      bindInstanceAttribs(first);
+      glState().blendFunc(GL_SRC_ALPHA, group.blend_dst);
+      group.texture.bind(group.texture.getUnit());
+      shader.setUniform1i("texture_sampler", group.texture.getUnit());
+      glDrawArraysInstanced(GL_TRIANGLES, 0, 6, group.instances.size());
+      first += group.instances.size();
+    }
   }
 
  private:
   /* PRIVATE MEMBER
   ** Initiate all parameters in particle system */
   void init() {
-    // Compute the period of this system and the total number of particles
-    period = 4.0f + drag_coef / 400.0f;
-    total_num = period * generate_speed;
-
     // Create total_num default particle instances
     particles.reserve(total_num);
     for (GLuint i = 0; i < total_num; i++)
-      particles.push_back(Particle(drag_coef, size));
+      particles.push_back(Particle());
 
     // Set the alive number = 0
     total_num_live = 0;
+    total_num_draw = 0;
+    last_particle = 0;
+
+    // A unit quad centered at the origin, scaled and rotated per instance in the shader
     GLfloat particle_quad[] =
         {
             // The position and texture coordinates
-            0.0f, size, 0.0f, 0.0f, 1.0f,
-            size, 0.0f, 0.0f, 1.0f, 0.0f,
-            0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+            -0.5f, 0.5f, 0.0f, 0.0f, 1.0f,
+            0.5f, -0.5f, 0.0f, 1.0f, 0.0f,
+            -0.5f, -0.5f, 0.0f, 0.0f, 0.0f,
 
-            0.0f, size, 0.0f, 0.0f, 1.0f,
-            size, size, 0.0f, 1.0f, 1.0f,
-            size, 0.0f, 0.0f, 1.0f, 0.0f};
-    particle_position_data = new GLfloat[3 * total_num];
+            -0.5f, 0.5f, 0.0f, 0.0f, 1.0f,
+            0.5f, 0.5f, 0.0f, 1.0f, 1.0f,
+            0.5f, -0.5f, 0.0f, 1.0f, 0.0f};
 
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO_quad);
-    glGenBuffers(1, &VBO_particle_position);
-    glBindVertexArray(VAO);
+    glGenBuffers(1, &VBO_particle_instance);
+    glState().bindVertexArray(VAO);
 
     // The data of VBO_quad is shared by every particle (instancing technique!)
     glBindBuffer(GL_ARRAY_BUFFER, VBO_quad);
     glBufferData(GL_ARRAY_BUFFER, sizeof(particle_quad), particle_quad, GL_STATIC_DRAW);
 
-    // The data of VBO_particle_position will be updated every frame
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_position);
-    glBufferData(GL_ARRAY_BUFFER, total_num * 3 * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+    // The data of VBO_particle_instance will be updated every frame
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_instance);
+    glBufferData(GL_ARRAY_BUFFER, total_num * sizeof(ParticleInstance), NULL, GL_STREAM_DRAW);
 
     glEnableVertexAttribArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, VBO_quad);
@@ -249,18 +461,32 @@ class ParticleSystem : public ParticleBase {
     glBindBuffer(GL_ARRAY_BUFFER, VBO_quad);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
     glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_position);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+    glEnableVertexAttribArray(3);
+    bindInstanceAttribs(0);
 
     // ----------------------------------------------------------------------------------
     // Particles vertices : always reuse the same 4 vertices -> 0
     // Particles uvs : always reuse the same 4 uvs  -> 0
-    // Positions of particle centers : one per quad -> 1
+    // Offsets of particle centers : one per quad -> 1
+    // Size, rotation and fade of particles : one per quad -> 1
     // ----------------------------------------------------------------------------------
     glVertexAttribDivisor(0, 0);
     glVertexAttribDivisor(1, 0);
     glVertexAttribDivisor(2, 1);
-    glBindVertexArray(0);
+    glVertexAttribDivisor(3, 1);
+    glState().bindVertexArray(0);
+  }
+
+  /* PRIVATE MEMBER
+  ** Point the per-instance attributes at the given instance of the shared buffer
+  ** ATTENTION: The VAO must be bound before calling this function. */
+  void bindInstanceAttribs(GLuint first) {
+    GLsizeiptr base = first * sizeof(ParticleInstance);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_particle_instance);
+    glVertexAttribPointer(2, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(ParticleInstance),
+                          (GLvoid*)(base + offsetof(ParticleInstance, offset)));
+    glVertexAttribPointer(3, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ParticleInstance),
+                          (GLvoid*)(base + offsetof(ParticleInstance, size)));
   }
 
   /* PRIVATE MEMBER
@@ -295,18 +521,115 @@ class ParticleSystem : public ParticleBase {
   }
 
   /* PRIVATE MEMBER
-  ** Respawn a certain number of particles from (almost) a plane
-  ** Use macro RANDOM_MIN_MAX to generate random number from (min, max) */
-  void respawn(Particle& particle) {
+  ** Respawn a particle from the box of the given emitter
+  ** Use function `random` to generate random number from (min, max) */
+  void respawn(Particle& particle, const GLuint& index) {
+    const ParticleEmitter& emitter = emitters[index];
+
     // Renew the position and velocity of this particle
-    particle.position.x = position_generator.x + RANDOM_MIN_MAX(-range_x, range_x);
-    particle.position.y = position_generator.y + RANDOM_MIN_MAX(-10, 0);
-    particle.position.z = position_generator.z + RANDOM_MIN_MAX(-range_z, range_z);
-    particle.velocity = glm::vec3(0.0f);
-
-    // Renew the life of this particle (notice the disturbing term)
-    // The foundamental life is related to the drag coefficient
-    particle.life = period;
+    particle.position.x = emitter.position.x + random(emitter.range_min.x, emitter.range_max.x);
+    particle.position.y = emitter.position.y + random(emitter.range_min.y, emitter.range_max.y);
+    particle.position.z = emitter.position.z + random(emitter.range_min.z, emitter.range_max.z);
+    particle.velocity.x = random(emitter.velocity_min.x, emitter.velocity_max.x);
+    particle.velocity.y = random(emitter.velocity_min.y, emitter.velocity_max.y);
+    particle.velocity.z = random(emitter.velocity_min.z, emitter.velocity_max.z);
+    particle.last_position = particle.position;
+    particle.drag_coef = emitter.drag_coef;
+
+    // Every snowflake gets its own size, orientation and spin
+    particle.size = random(0.5f * emitter.size, 1.5f * emitter.size);
+    particle.rotation = random(0.0f, 2.0f * M_PI);
+    particle.spin = random(-2.0f, 2.0f);
+
+    // Renew the life of this particle
+    particle.lod_rank = random(0.0f, 1.0f);
+    particle.life = emitter.period;
+    particle.period = emitter.period;
+    particle.emitter = index;
+  }
+
+  /* PRIVATE MEMBER
+  ** Advance the simulation by one fixed step @h */
+  void step(const GLfloat& h) {
+    // Create new particles for every active emitter
+    // The fractional part of the spawn count is carried over to the next step
+    for (GLuint e = 0; e < emitters.size(); ++e) {
+      if (!emitters[e].active) continue;
+      emitters[e].spawn_carry += h * emitters[e].generate_speed;
+      GLuint num_new_particles = emitters[e].spawn_carry;
+      emitters[e].spawn_carry -= num_new_particles;
+      burst(e, num_new_particles);
+    }
+
+    // update all particles
+    for (GLuint i = 0; i < total_num; i++) {
+      // For each particle, decrease life
+      Particle& particle = particles[i];
+      if (particle.life <= 0.0f) continue;
+      particle.life -= h;
+      if (particle.life <= 0.0f) continue;
+
+      // Compute drag of the current particle
+      particle.updateDrag();
+
+      // Use the mechanical model! (semi-implicit Euler)
+      particle.last_position = particle.position;
+      particle.velocity += (particle.gravity + particle.drag) * h;
+      particle.position += particle.velocity * h;
+      particle.rotation += particle.spin * h;
+
+      // Retire the particle if it hits the ground
+      if (ground) {
+        GLfloat height = ground(particle.position.x, particle.position.z);
+        if (particle.position.y <= height) {
+          particle.life = -1.0f;
+          if (record_impacts)
+            impacts.push_back(glm::vec3(particle.position.x, height, particle.position.z));
+        }
+      }
+    }
+  }
+
+  /* PRIVATE MEMBER
+  ** Returns a random number from (min, max), using the generator of this system */
+  GLfloat random(const GLfloat& min, const GLfloat& max) {
+    return std::uniform_real_distribution<GLfloat>(min, max)(generator);
+  }
+
+  /* PRIVATE MEMBER
+  ** Whether a living particle should be uploaded this frame
+  ** Particles outside the camera frustum are culled, and distant particles are
+  ** thinned by comparing their fixed rank with the density at their distance. */
+  GLboolean isVisible(const Particle& particle, const glm::vec3& position) {
+    if (!culling) return true;
+    if (!frustum.containsSphere(position, 0.75f * particle.size))
+      return false;
+
+    GLfloat distance = glm::distance(position, eye);
+    if (distance <= lod_near) return true;
+    GLfloat t = glm::min((distance - lod_near) / (lod_far - lod_near), 1.0f);
+    return particle.lod_rank < 1.0f - t * (1.0f - lod_min_density);
+  }
+
+  /* PRIVATE MEMBER
+  ** Pack the attributes of a living particle (at the interpolated @position and
+  ** @rotation) into the upload format.
+  ** The position is stored relative to @origin so half floats are precise enough. */
+  void pack(const Particle& particle,
+            const glm::vec3& position,
+            const GLfloat& rotation,
+            ParticleInstance& instance) {
+    glm::vec3 offset = position - origin;
+    instance.offset[0] = glm::packHalf1x16(offset.x);
+    instance.offset[1] = glm::packHalf1x16(offset.y);
+    instance.offset[2] = glm::packHalf1x16(offset.z);
+
+    // Rotation is periodic, so only the fractional part of a full turn is kept
+    GLfloat turn = rotation / (2.0f * M_PI);
+    instance.size = glm::packUnorm1x8(particle.size / max_size);
+    instance.rotation = glm::packUnorm1x8(turn - floor(turn));
+    instance.fade = glm::packUnorm1x8(glm::min(4.0f * particle.life / particle.period, 1.0f));
+    instance.padding = 0;
   }
 
   /* PRIVATE MEMBER
@@ -314,43 +637,74 @@ class ParticleSystem : public ParticleBase {
   Shader shader;
 
   /* PRIVATE MEMBER
-  ** The texture we use to attach to each particle */
-  Texture texture;
+  ** The vector records all particles (the shared pool) */
+  std::vector<Particle> particles;
 
   /* PRIVATE MEMBER
-  ** The vector records all particles */
-  std::vector<Particle> particles;
+  ** The emitters allocating particles from the pool */
+  std::vector<ParticleEmitter> emitters;
 
   /* PRIVATE MEMBER
-  ** Positions of particle centers every frame (updated every frame) */
-  GLfloat* particle_position_data;
+  ** The render groups (texture and blend mode) */
+  std::vector<ParticleGroup> groups;
 
   /* PRIVATE MEMBERS
-  ** @param total_num: The maximum number of particles
-  ** @param generate_speed: The number of new particles generated for a second
-  ** @param total_num_live: The number of living particles */
-  GLuint total_num, generate_speed, total_num_live;
+  ** @param total_num: The maximum number of particles (size of the pool)
+  ** @param total_num_live: The number of living particles
+  ** @param total_num_draw: The number of living particles uploaded and drawn */
+  GLuint total_num, total_num_live, total_num_draw;
 
   /* PRIVATE MEMBER
-  ** The position of the generator */
-  glm::vec3 position_generator;
+  ** The point which uploaded particle positions are relative to
+  ** Keep it near the camera, because the offsets are stored as half floats. */
+  glm::vec3 origin;
+
+  /* PRIVATE MEMBER
+  ** The largest size a particle can have (the 8-bit size is normalized by it) */
+  GLfloat max_size;
+
+  /* PRIVATE MEMBERS
+  ** @param ground: The ground height function (collision disabled if empty)
+  ** @param record_impacts: Whether to record the impact points
+  ** @param impacts: The impact points of particles in the last update */
+  GroundHeightFunc ground;
+  GLboolean record_impacts;
+  std::vector<glm::vec3> impacts;
 
   /* PRIVATE MEMBERS
-  ** The range within which we respawn particles */
-  GLfloat range_x, range_z;
+  ** The camera frustum and position used to cull particles during update */
+  Frustum frustum;
+  glm::vec3 eye;
+
+  /* PRIVATE MEMBERS
+  ** The distance LOD: full density within @lod_near, @lod_min_density beyond @lod_far */
+  GLfloat lod_near, lod_far, lod_min_density;
+
+  /* PRIVATE MEMBER
+  ** Whether a view has been set (culling disabled otherwise) */
+  GLboolean culling;
+
+  /* PRIVATE MEMBERS
+  ** @param time_step: The fixed time step of the simulation
+  ** @param max_steps: The maximum number of steps in one update
+  ** @param accumulator: The time passed but not simulated yet */
+  GLfloat time_step;
+  GLuint max_steps;
+  GLfloat accumulator;
+
+  /* PRIVATE MEMBER
+  ** The random number generator of this system
+  ** Seed it (see `setSeed`) to make the particles reproducible. */
+  std::minstd_rand generator;
 
   /* PRIVATE MEMBERS
   ** The VAO and VBOs of the particle system */
-  GLuint VAO, VBO_quad, VBO_particle_position;
+  GLuint VAO, VBO_quad, VBO_particle_instance;
 
   /* PRIVATE MEMBER
   ** Stores the index of the last particle used.
   ** For quick access to next dead particle. */
   GLuint last_particle;
-
-  /* PRIVATE MEMBER
-  ** The period of particle generation */
-  GLfloat period;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,153 @@
+/*******************************************************************************
+** Software License Agreement (GNU GENERAL PUBLIC LICENSE)
+**
+** Copyright 2016-2017  Peiyu Liao (enzoliao95@gmail.com). All rights reserved.
+** Copyright 2016-2017  Yaohong Wu (wuyaohongdio@gmail.com). All rights reserved.
+**
+** LICENSE INFORMATION (GPL)
+** SEE `LICENSE` FILE.
+*******************************************************************************/
+
+#ifndef _PRIMITIVES_H_
+#define _PRIMITIVES_H_
+
+#include <GL/glew.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "frustum.h"
+#include "gl_state.h"
+
+/* ENUM TYPE
+** The procedural primitives (see `primitiveMesh`) */
+enum PrimitiveType {
+  PRIMITIVE_QUAD,    // The unit square in the plane xOy, centered at the origin
+  PRIMITIVE_CUBE,    // The unit cube centered at the origin
+  PRIMITIVE_SPHERE   // The sphere of radius 1 centered at the origin
+};
+
+/* STRUCT: The GPU buffers of a primitive, shared by all objects of the same type and
+** tessellation. The vertices are interleaved: position (3), normal (3), UV (2).
+** @param VBO, EBO: The vertex and index buffers
+** @param num_indices: The number of indices (GL_TRIANGLES)
+** @param bounds: The bounding sphere in model space */
+struct PrimitiveMesh {
+  GLuint VBO, EBO;
+  GLuint num_indices;
+  BoundingSphere bounds;
+};
+
+/* The number of floats of a primitive vertex */
+const GLuint PRIMITIVE_VERTEX_SIZE = 8;
+
+/* PRIVATE FUNCTIONS: Build the vertices and the indices of a primitive
+** (`inline` as `primitiveMesh` which calls them) */
+inline void buildQuad(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices) {
+  static const GLfloat g_vertices_square[] = {
+      // Positions, Normals, Texture Coordinates
+      0.5f, 0.5f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f,    // Top Right
+      0.5f, -0.5f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f,   // Bottom Right
+      -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f,  // Bottom Left
+      -0.5f, 0.5f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f    // Top Left
+  };
+  static const GLuint g_indices_square[] = {
+      // Note that we start from 0!
+      0, 1, 3,  // First Triangle
+      1, 2, 3   // Second Triangle
+  };
+  vertices.assign(g_vertices_square, g_vertices_square + 4 * PRIMITIVE_VERTEX_SIZE);
+  indices.assign(g_indices_square, g_indices_square + 6);
+}
+
+inline void buildCube(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices) {
+  // Each face: its normal and the axes of its UV (`cross(u, v) == normal`, so the
+  // corners turn counter-clockwise seen from outside)
+  static const GLfloat faces[6][9] = {
+      {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f},   // Right
+      {-1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f},   // Left
+      {0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f},   // Top
+      {0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f},   // Bottom
+      {0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f},    // Front
+      {0.0f, 0.0f, -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f}   // Back
+  };
+  static const GLfloat corners[4][2] = {{0.0f, 0.0f}, {1.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 1.0f}};
+
+  for (GLuint f = 0; f < 6; ++f) {
+    glm::vec3 normal(faces[f][0], faces[f][1], faces[f][2]);
+    glm::vec3 u(faces[f][3], faces[f][4], faces[f][5]);
+    glm::vec3 v(faces[f][6], faces[f][7], faces[f][8]);
+    GLuint first = vertices.size() / PRIMITIVE_VERTEX_SIZE;
+    for (GLuint c = 0; c < 4; ++c) {
+      glm::vec3 position = 0.5f * normal + (corners[c][0] - 0.5f) * u + (corners[c][1] - 0.5f) * v;
+      GLfloat vertex[] = {position.x, position.y, position.z, normal.x, normal.y, normal.z, corners[c][0], corners[c][1]};
+      vertices.insert(vertices.end(), vertex, vertex + PRIMITIVE_VERTEX_SIZE);
+    }
+    GLuint face_indices[] = {first, first + 1, first + 2, first, first + 2, first + 3};
+    indices.insert(indices.end(), face_indices, face_indices + 6);
+  }
+}
+
+inline void buildSphere(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices,
+                        const GLint& slices, const GLint& stacks) {
+  // A grid of (slices + 1) x (stacks + 1) vertices, from the south pole up
+  // The first and the last column meet at the seam of the texture
+  for (GLint i = 0; i <= stacks; i++) {
+    GLfloat latitude = M_PI * (-0.5f + (GLfloat)i / stacks);
+    for (GLint j = 0; j <= slices; j++) {
+      GLfloat longitude = 2.0f * M_PI * (GLfloat)j / slices;
+      glm::vec3 position(cos(latitude) * sin(longitude), sin(latitude), cos(latitude) * cos(longitude));
+      GLfloat vertex[] = {position.x, position.y, position.z, position.x, position.y, position.z,
+                          (GLfloat)j / slices, (GLfloat)i / stacks};
+      vertices.insert(vertices.end(), vertex, vertex + PRIMITIVE_VERTEX_SIZE);
+    }
+  }
+  for (GLint i = 0; i < stacks; i++) {
+    for (GLint j = 0; j < slices; j++) {
+      GLuint a = i * (slices + 1) + j, b = a + 1, c = a + slices + 1, d = c + 1;
+      GLuint quad[] = {a, b, d, a, d, c};
+      indices.insert(indices.end(), quad, quad + 6);
+    }
+  }
+}
+
+/* The primitive @type (@slices x @stacks for spheres), built and uploaded on first use
+** and shared afterwards (`inline`: one cache for the whole program). Must be called
+** after `glewInit()`. */
+inline const PrimitiveMesh& primitiveMesh(const PrimitiveType& type, const GLint& slices = 0, const GLint& stacks = 0) {
+  static std::unordered_map<GLuint64, PrimitiveMesh> meshes;
+  GLuint64 key = ((GLuint64)type << 48) | ((GLuint64)(slices & 0xFFFFFF) << 24) | (GLuint64)(stacks & 0xFFFFFF);
+  std::unordered_map<GLuint64, PrimitiveMesh>::iterator found = meshes.find(key);
+  if (found != meshes.end()) return found->second;
+
+  std::vector<GLfloat> vertices;
+  std::vector<GLuint> indices;
+  if (type == PRIMITIVE_QUAD)
+    buildQuad(vertices, indices);
+  else if (type == PRIMITIVE_CUBE)
+    buildCube(vertices, indices);
+  else
+    buildSphere(vertices, indices, glm::max(slices, 3), glm::max(stacks, 2));
+
+  PrimitiveMesh mesh;
+  mesh.num_indices = indices.size();
+  mesh.bounds = BoundingSphere::fromPoints(vertices.data(), vertices.size() / PRIMITIVE_VERTEX_SIZE, PRIMITIVE_VERTEX_SIZE);
+  glGenBuffers(1, &mesh.VBO);
+  glGenBuffers(1, &mesh.EBO);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // The element buffer binding is part of the VAO state, do not touch the bound one
+  glState().bindVertexArray(0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  meshes[key] = mesh;
+  return meshes[key];
+}
+
+#endif
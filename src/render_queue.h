@@ -0,0 +1,128 @@
+/*******************************************************************************
+** Software License Agreement (GNU GENERAL PUBLIC LICENSE)
+**
+** Copyright 2016-2017  Peiyu Liao (enzoliao95@gmail.com). All rights reserved.
+** Copyright 2016-2017  Yaohong Wu (wuyaohongdio@gmail.com). All rights reserved.
+**
+** LICENSE INFORMATION (GPL)
+** SEE `LICENSE` FILE.
+*******************************************************************************/
+
+#ifndef _RENDER_QUEUE_H_
+#define _RENDER_QUEUE_H_
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <functional>
+#include <glm/glm.hpp>
+#include <vector>
+
+/* ENUM TYPE
+** The passes of the render queue, drawn in this order */
+enum RenderPass {
+  PASS_OPAQUE,       // Sorted by state, then front-to-back (early-Z)
+  PASS_TRANSPARENT,  // Sorted back-to-front, then by state
+  PASS_OVERLAY       // HUD, drawn in submission order
+};
+
+/* STRUCT: A draw submitted to the render queue
+** @param key: The sort key (see `RenderQueue::makeKey`)
+** @param draw: Binds what it needs and draws (through `GLState`) */
+struct DrawPacket {
+  GLuint64 key;
+  std::function<void()> draw;
+};
+
+/* CLASS: Render queue
+** Objects submit draw packets instead of drawing in a hard-coded order. The packets
+** are sorted by a 64-bit key and executed, so draws sharing a program, a texture and
+** a VAO end up next to each other and `GLState` skips the repeated binds.
+**
+** Key layout (high bits first):
+**   opaque:      pass(2) | program(10) | texture(16) | VAO(16) | depth(20)
+**   transparent: pass(2) | inverted depth(20) | program(10) | texture(16) | VAO(16)
+**   overlay:     pass(2) | submission order(62) */
+class RenderQueue {
+ public:
+  /* Default constructor */
+  RenderQueue()
+      : eye(0.0f),
+        far_plane(100.0f) {  // Do nothing here
+  }
+
+  /* Set the point the depth of the packets is measured from
+  ** @param _far_plane: The depth beyond which all packets share the same key */
+  void setView(const glm::vec3& _eye, const GLfloat& _far_plane) {
+    eye = _eye;
+    far_plane = _far_plane;
+  }
+
+  /* Returns the number of packets submitted */
+  const GLuint size() { return packets.size(); }
+
+  /* Drop the packets (keeps the memory for the next frame) */
+  void clear() { packets.clear(); }
+
+  /* Submit a draw
+  ** @param program, texture, VAO: The GL names bound by the draw (0 if several)
+  ** @param position: A point of the object in world space, used for the depth */
+  void submit(const RenderPass& pass,
+              const GLuint& program,
+              const GLuint& texture,
+              const GLuint& VAO,
+              const glm::vec3& position,
+              const std::function<void()>& draw) {
+    DrawPacket packet;
+    if (pass == PASS_OVERLAY)
+      packet.key = ((GLuint64)pass << 62) | packets.size();
+    else
+      packet.key = makeKey(pass, program, texture, VAO, glm::length(position - eye) / far_plane);
+    packet.draw = draw;
+    packets.push_back(packet);
+  }
+
+  /* Sort the packets and draw them
+  ** The sort is stable, packets with equal keys keep their submission order. */
+  void execute() {
+    std::stable_sort(packets.begin(), packets.end(), keyLess);
+    for (GLuint i = 0; i < packets.size(); ++i)
+      packets[i].draw();
+  }
+
+  /* Build the sort key of a packet
+  ** @param depth: The normalized depth in [0, 1] (clamped) */
+  static GLuint64 makeKey(const RenderPass& pass,
+                          const GLuint& program,
+                          const GLuint& texture,
+                          const GLuint& VAO,
+                          const GLfloat& depth) {
+    GLuint64 quantized = (GLuint64)(glm::clamp(depth, 0.0f, 1.0f) * DEPTH_MASK);
+    GLuint64 state = ((GLuint64)(program & PROGRAM_MASK) << 32) |
+                     ((GLuint64)(texture & 0xFFFF) << 16) |
+                     (GLuint64)(VAO & 0xFFFF);
+    if (pass == PASS_TRANSPARENT)
+      return ((GLuint64)pass << 62) | ((DEPTH_MASK - quantized) << 42) | state;
+    return ((GLuint64)pass << 62) | (state << 20) | quantized;
+  }
+
+ private:
+  /* The widths of the key fields */
+  static const GLuint64 PROGRAM_MASK = 0x3FF;
+  static const GLuint64 DEPTH_MASK = 0xFFFFF;
+
+  /* PRIVATE MEMBER: Order of the packets */
+  static bool keyLess(const DrawPacket& a, const DrawPacket& b) { return a.key < b.key; }
+
+  /* PRIVATE MEMBERS
+  ** @param eye: The point the depth is measured from
+  ** @param far_plane: The depth mapped to the largest key */
+  glm::vec3 eye;
+  GLfloat far_plane;
+
+  /* PRIVATE MEMBER
+  ** The packets of the pass being built */
+  std::vector<DrawPacket> packets;
+};
+
+#endif
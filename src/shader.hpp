@@ -15,13 +15,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include <memory>
 #include <print>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "gl_state.h"
+
+// The shader sources embedded at build time (see `cmake/EmbedShaders.cmake`)
+#if __has_include("embedded_shaders.h")
+#include "embedded_shaders.h"
+#define SHADERS_EMBEDDED
+#endif
 
 /* ENUM TYOE
 ** The function type pf shader */
@@ -30,7 +45,10 @@ enum shaderFuncType {
   DEPTH,
   PARTICLE,
   DEBUG,
-  BILLBOARD
+  BILLBOARD,
+  SNOW,
+  GRASS,
+  IMPOSTOR
 };
 
 /* ENUM TYPE
@@ -43,77 +61,237 @@ enum ShaderCompileOption {
   GEOMETRY
 };
 
+/* ENUM TYPE
+** The binding points of the uniform blocks shared by all programs
+** (see `uniform_blocks.h`) */
+enum UniformBlockBinding {
+  FRAME_DATA_BINDING,
+  OBJECT_DATA_BINDING
+};
+
 /* Shader type definition */
 typedef GLuint shaderProgType;
 typedef GLboolean shaderInstallType;
 
+/* The feature set of a shader variant, one `#define` each: "NAME" or "NAME VALUE"
+** (e.g. {"SHADOWS", "PCF_KERNEL 2"}) */
+typedef std::vector<std::string> ShaderDefines;
+
+/* The number of shadow cascades (2 ~ 4, their splits share one vec4)
+** Every shader is built with it as `NUM_CASCADES` (see `injectDefines`), which sizes
+** `lightSpace` of the block `FrameData` (see `uniform_blocks.h`) */
+const GLuint NUM_SHADOW_CASCADES = 3;
+static_assert(NUM_SHADOW_CASCADES >= 2 && NUM_SHADOW_CASCADES <= 4, "2 ~ 4 shadow cascades");
+
+/* CLASS: Interned uniform name
+** Each distinct name gets a small id once, shaders keep their locations in a table
+** indexed by this id. Declare the names used every frame once (e.g. `static const`)
+** and pass them to the `setUniform*` functions, no string is built or hashed then. */
+class UniformName {
+ public:
+  UniformName(const std::string& name) : id(intern(name)) {}
+  UniformName(const char* name) : id(intern(name)) {}
+
+  const GLuint getID() const { return id; }
+  const std::string& getName() const { return names()[id]; }
+
+  /* The number of names interned so far */
+  static GLuint count() { return names().size(); }
+
+ private:
+  /* All names interned so far (the index is the id) */
+  static std::vector<std::string>& names() {
+    static std::vector<std::string> registry;
+    return registry;
+  }
+
+  static GLuint intern(const std::string& name) {
+    std::vector<std::string>& registry = names();
+    for (GLuint i = 0; i < registry.size(); ++i)
+      if (registry[i] == name) return i;
+    registry.push_back(name);
+    return registry.size() - 1;
+  }
+
+  GLuint id;
+};
+
+/* STRUCT: Transparent string hash, so C strings are looked up without building a std::string */
+struct UniformNameHash {
+  typedef void is_transparent;
+  size_t operator()(std::string_view name) const { return std::hash<std::string_view>()(name); }
+};
+
+/* STRUCT: The active uniforms of a linked program
+** @param by_name: The locations reflected with `glGetActiveUniform` after linking
+** @param by_id: The locations of interned names (-2: not resolved yet) */
+struct UniformTable {
+  typedef std::unordered_map<std::string, GLint, UniformNameHash, std::equal_to<> > NameMap;
+  NameMap by_name;
+  std::vector<GLint> by_id;
+};
+
+/* STRUCT: The link of a program, shared by all copies of a shader
+** @param vertex, fragment: The shaders compiled from the sources (0 if loaded from the
+**     binary cache), kept until their logs are checked
+** @param hash: The hash of the sources (see `Shader::submit`)
+** @param done: Whether the link is checked and the uniforms are reflected */
+struct ShaderLink {
+  GLuint vertex = 0, fragment = 0;
+  GLuint64 hash = 0;
+  GLboolean done = true;
+};
+
 /* CLASS: Shader
 ** Used in GLSL-binding */
 class Shader {
  public:
   /* Default constructor */
   Shader()
-      : install_flag(false) {  // Do nothing here
+      : program(0),
+        install_flag(false),
+        func(NORMAL),
+        uniforms(std::make_shared<UniformTable>()),
+        link(std::make_shared<ShaderLink>()) {  // Do nothing here
   }
 
   /* Constructor with parameters which generates the shader */
   Shader(const char* vertex_shader_path,
          const char* fragment_shader_path)
-      : install_flag(false) {
+      : install_flag(false),
+        uniforms(std::make_shared<UniformTable>()),
+        link(std::make_shared<ShaderLink>()) {
     reload(vertex_shader_path,
            fragment_shader_path);
   }
 
+  /* Returns the variant of the shaders built with the feature set @defines
+  ** Each variant is compiled once, then shared (copies of a shader share its program).
+  ** Set the function type and the uniforms of a new variant, like after `reload`.
+  ** The variant is only submitted (see `submit`), it is finished when installed. */
+  static Shader variant(const char* vertex_shader_path,
+                        const char* fragment_shader_path,
+                        const ShaderDefines& defines = ShaderDefines()) {
+    std::string key = std::string(vertex_shader_path) + "\n" + fragment_shader_path;
+    for (GLuint i = 0; i < defines.size(); ++i)
+      key += "\n" + defines[i];
+
+    std::unordered_map<std::string, Shader>& cache = variants();
+    std::unordered_map<std::string, Shader>::iterator iter = cache.find(key);
+    if (iter != cache.end()) return iter->second;
+
+    Shader shader;
+    shader.submit(vertex_shader_path, fragment_shader_path, defines);
+    cache[key] = shader;
+    return shader;
+  }
+
+  /* Let the driver compile on its own threads (GL_KHR/ARB_parallel_shader_compile)
+  ** Call it once the context is current, before submitting shaders. */
+  static void enableParallelCompile() {
+    if (GLEW_KHR_parallel_shader_compile)
+      glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else if (GLEW_ARB_parallel_shader_compile)
+      glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+  }
+
+  /* Finish the submitted programs whose compilation is complete, never blocks
+  ** Call it every frame while shaders are compiling (see `isReady`). */
+  static void finishReady() {
+    std::unordered_map<GLuint64, Shader>& linked = programs();
+    for (std::unordered_map<GLuint64, Shader>::iterator iter = linked.begin(); iter != linked.end(); ++iter)
+      if (iter->second.isReady()) iter->second.finish();
+  }
+
   /* Reload function
   ** If you need to load new shaders or reload shaders from other paths,
   ** especially when you declare a new shader object by default constructor
-  ** (that means no parameter), this function is provided.*/
+  ** (that means no parameter), this function is provided.
+  ** @param defines: The features of the variant (see `ShaderDefines`), injected
+  **     after the `#version` line of both shaders */
   void reload(const char* vertex_shader_path,
-              const char* fragment_shader_path) {
+              const char* fragment_shader_path,
+              const ShaderDefines& defines = ShaderDefines()) {
+    submit(vertex_shader_path, fragment_shader_path, defines);
+    finish();
+  }
+
+  /* Submit the shaders for compiling and linking without waiting for the driver
+  ** Nothing is checked here, so the driver may compile all submitted shaders at once.
+  ** The program is finished (checked and reflected) by `finish`, which `install`
+  ** calls when needed. */
+  void submit(const char* vertex_shader_path,
+              const char* fragment_shader_path,
+              const ShaderDefines& defines = ShaderDefines()) {
     // Declare file variables
     // These variables are supposed to retrieve the source GLSL code
-    std::string vs_code = loadCode(vertex_shader_path, VERTEX);
-    std::string fs_code = loadCode(fragment_shader_path, FRAGMENT);
-    const char* vert_shader_code = vs_code.c_str();
-    const char* frag_shader_code = fs_code.c_str();
+    std::string vs_code = injectDefines(loadCode(vertex_shader_path, VERTEX), defines);
+    std::string fs_code = injectDefines(loadCode(fragment_shader_path, FRAGMENT), defines);
+
+    // The same sources (on the same driver) are linked once per run, and their binary
+    // is cached on disk for the next runs (see `loadBinary`)
+    GLuint64 hash = hashSource(driverID() + '\0' + vs_code + '\0' + fs_code);
+    std::unordered_map<GLuint64, Shader>& linked = programs();
+    std::unordered_map<GLuint64, Shader>::iterator iter = linked.find(hash);
+    if (iter != linked.end()) {
+      program = iter->second.program;
+      uniforms = iter->second.uniforms;
+      link = iter->second.link;
+      return;
+    }
 
-    // Create vertex and fragment Shader from source code string
-    // Compile GLSL code and report error.
-    shaderProgType vertex = glCreateShader(GL_VERTEX_SHADER);
-    shaderProgType fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(vertex, 1, &vert_shader_code, nullptr);
-    glShaderSource(fragment, 1, &frag_shader_code, nullptr);
-    glCompileShader(vertex);
-    glCompileShader(fragment);
-    compileErrLog(vertex, VERTEX);
-    compileErrLog(fragment, FRAGMENT);
+    uniforms = std::make_shared<UniformTable>();
+    link = std::make_shared<ShaderLink>();
+    link->hash = hash;
+    link->done = false;
+    if (!loadBinary(hash)) compile(vs_code, fs_code);
+    linked[hash] = *this;
+  }
 
-    // Create shader program and attach vertex & fragment shaders
-    program = glCreateProgram();
-    glAttachShader(program, vertex);
-    glAttachShader(program, fragment);
+  /* Whether the program can be finished without blocking
+  ** The completion is polled with GL_COMPLETION_STATUS_KHR. Without the parallel
+  ** compile extensions it cannot be polled, the program is finished when installed. */
+  GLboolean isReady() {
+    if (link->done) return true;
+    if (!GLEW_KHR_parallel_shader_compile && !GLEW_ARB_parallel_shader_compile) return false;
+    GLint status = 0;
+    glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &status);
+    return status;
+  }
 
-    // Delete the shaders as they're linked into our program now and no longer necessery
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+  /* Check the submitted program, cache its binary and reflect its uniforms
+  ** Blocks until the driver is done with it. Done once for all copies. */
+  void finish() {
+    if (link->done) return;
+    if (link->vertex) {  // Compiled from the sources
+      compileErrLog(link->vertex, VERTEX);
+      compileErrLog(link->fragment, FRAGMENT);
+      compileErrLog(program, PROGRAM);
+      glDeleteShader(link->vertex);
+      glDeleteShader(link->fragment);
+      link->vertex = link->fragment = 0;
+      saveBinary(link->hash);
+    }
 
-    // Link shader program and compile GLSL program
-    // If error occurs, report it to console
-    glLinkProgram(program);
-    compileErrLog(program, PROGRAM);
+    // Cache the locations of all active uniforms and attach the uniform blocks
+    reflectUniforms();
+    bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+    bindUniformBlock("ObjectData", OBJECT_DATA_BINDING);
+    link->done = true;
   }
 
-  /* Install the current shader */
+  /* Install the current shader (finishes it first if needed, see `submit`) */
   void install() {
-    glUseProgram(program);
+    if (!link->done) finish();
+    glState().useProgram(program);
     install_flag = true;
   }
 
-  /* Uninstall a shader */
+  /* Uninstall a shader
+  ** The program stays bound (see `GLState`), the next `install` replaces it. */
   void uninstall() {
     // If a shader has been installed before and not uninstalled yet
     if (install_flag) {
-      glUseProgram(0);
       install_flag = false;
     }  // Else print a WARNING to console
     else
@@ -131,73 +309,318 @@ class Shader {
   /* Set some private members */
   void setFuncType(shaderFuncType _func) { func = _func; }
 
-  /* Other settings (used in GLSL-shader) */
+  /* The directory of the program binary cache (see `loadBinary`) */
+  static std::string& cacheDirectory() {
+    static std::string directory = "../shader_cache/";
+    return directory;
+  }
+
+  /* Returns the location of a uniform (-1 if it is not active)
+  ** Both look in the table built after linking, no GL call is made. */
+  const GLint getLocation(const char* name) {
+    UniformTable::NameMap::const_iterator iter = uniforms->by_name.find(std::string_view(name));
+    return iter == uniforms->by_name.end() ? -1 : iter->second;
+  }
+  const GLint getLocation(const UniformName& name) {
+    std::vector<GLint>& by_id = uniforms->by_id;
+    if (name.getID() >= by_id.size())
+      by_id.resize(UniformName::count(), -2);
+    if (by_id[name.getID()] == -2)
+      by_id[name.getID()] = getLocation(name.getName().c_str());
+    return by_id[name.getID()];
+  }
+
+  /* The number of `glGetUniformLocation` calls made by all shaders
+  ** It only grows when a program is linked, use it to check that no lookup is left
+  ** in the render loop. */
+  static GLuint getLookupCount() { return lookup_count(); }
+
+  /* Other settings (used in GLSL-shader)
+  ** Each setter takes the name as a string or as an interned name (faster) */
   /* Set uniform matrix */
-  void setUniformMatrix4fv(const char* name,
+  template <typename Name>
+  void setUniformMatrix4fv(const Name& name,
                            const glm::mat4& matrix) {
-    GLint matrixID = glGetUniformLocation(program, name);
-    glUniformMatrix4fv(matrixID, 1, GL_FALSE, glm::value_ptr(matrix));
+    glUniformMatrix4fv(getLocation(name), 1, GL_FALSE, glm::value_ptr(matrix));
   }
 
   /* Set uniform3f */
-  void setUniform3f(const char* name,
+  template <typename Name>
+  void setUniform3f(const Name& name,
                     const glm::vec3& vector) {
-    GLint vectorID = glGetUniformLocation(program, name);
-    glUniform3f(vectorID, vector.x, vector.y, vector.z);
+    glUniform3f(getLocation(name), vector.x, vector.y, vector.z);
   }
 
   /* Set uniform 3fv */
-  void setUniform3fv(const char* name,
+  template <typename Name>
+  void setUniform3fv(const Name& name,
                      const glm::vec3& vector) {
-    GLint vectorID = glGetUniformLocation(program, name);
-    glUniform3fv(vectorID, 1, glm::value_ptr(vector));
+    glUniform3fv(getLocation(name), 1, glm::value_ptr(vector));
   }
 
   /* Set uniform 4f */
-  void setUniform4f(const char* name,
+  template <typename Name>
+  void setUniform4f(const Name& name,
                     const glm::vec4& vector) {
-    GLint vectorID = glGetUniformLocation(program, name);
-    glUniform4f(vectorID, vector.x, vector.y, vector.z, vector.w);
+    glUniform4f(getLocation(name), vector.x, vector.y, vector.z, vector.w);
   }
 
   /* Set uniform 1f */
-  void setUniform1f(const char* name,
+  template <typename Name>
+  void setUniform1f(const Name& name,
                     const float& value) {
-    GLint floatID = glGetUniformLocation(program, name);
-    glUniform1f(floatID, value);
+    glUniform1f(getLocation(name), value);
   }
 
   /* Set uniform 1i */
-  void setUniform1i(const char* name,
+  template <typename Name>
+  void setUniform1i(const Name& name,
                     const int& value) {
-    GLint intID = glGetUniformLocation(program, name);
-    glUniform1i(intID, value);
+    glUniform1i(getLocation(name), value);
   }
 
  private:
-  /* Load code string (pointer) from files.
-  ** Return a pointer!
+  /* PRIVATE MEMBER
+  ** Compile the sources and link them into a new program
+  ** Nothing is queried, the logs are checked by `finish`. */
+  void compile(const std::string& vs_code, const std::string& fs_code) {
+    const char* vert_shader_code = vs_code.c_str();
+    const char* frag_shader_code = fs_code.c_str();
+
+    // Create vertex and fragment Shader from source code string
+    // Compile GLSL code and report error.
+    shaderProgType vertex = glCreateShader(GL_VERTEX_SHADER);
+    shaderProgType fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(vertex, 1, &vert_shader_code, nullptr);
+    glShaderSource(fragment, 1, &frag_shader_code, nullptr);
+    glCompileShader(vertex);
+    glCompileShader(fragment);
+
+    // Create shader program and attach vertex & fragment shaders
+    // The shaders are deleted once their logs are checked (see `finish`)
+    program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    link->vertex = vertex;
+    link->fragment = fragment;
+
+    // Link shader program and compile GLSL program
+    if (binarySupported())
+      glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+  }
+
+  /* PRIVATE MEMBER
+  ** Load the program from the binary cache
+  ** The file starts with the driver it was built by. A missing file, another driver,
+  ** or a binary the driver rejects returns false (compile from the sources then). */
+  GLboolean loadBinary(const GLuint64& hash) {
+    if (!binarySupported()) return false;
+    std::ifstream file(cachePath(hash), std::ios::binary);
+    if (!file) return false;
+
+    std::string driver;
+    GLenum format = 0;
+    GLint length = 0;
+    std::getline(file, driver, '\0');
+    file.read((char*)&format, sizeof(format));
+    file.read((char*)&length, sizeof(length));
+    if (!file || driver != driverID() || length <= 0) return false;
+    std::vector<char> binary(length);
+    file.read(binary.data(), length);
+    if (!file) return false;
+
+    program = glCreateProgram();
+    glProgramBinary(program, format, binary.data(), length);
+    GLint status = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+      glDeleteProgram(program);
+      program = 0;
+      return false;
+    }
+    return true;
+  }
+
+  /* PRIVATE MEMBER
+  ** Write the linked program to the binary cache (failures are ignored) */
+  void saveBinary(const GLuint64& hash) {
+    if (!binarySupported()) return;
+    GLint status = 0, length = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (!status || length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory(), error);
+    std::ofstream file(cachePath(hash), std::ios::binary | std::ios::trunc);
+    if (!file) return;
+    std::string driver = driverID();
+    file.write(driver.c_str(), driver.size() + 1);
+    file.write((const char*)&format, sizeof(format));
+    file.write((const char*)&length, sizeof(length));
+    file.write(binary.data(), length);
+  }
+
+  /* The file of the program with the hash @hash in the binary cache */
+  static std::string cachePath(const GLuint64& hash) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+    return cacheDirectory() + name;
+  }
+
+  /* Whether the driver can return program binaries (GL_ARB_get_program_binary) */
+  static GLboolean binarySupported() {
+    static GLint formats = -1;
+    if (formats < 0) {
+      formats = 0;
+      if (GLEW_ARB_get_program_binary || GLEW_VERSION_4_1)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    return formats > 0;
+  }
+
+  /* The driver the binaries are built by: vendor, renderer and version */
+  static const std::string& driverID() {
+    static std::string id;
+    if (id.empty()) {
+      const GLubyte* strings[] = {glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION)};
+      for (GLuint i = 0; i < 3; ++i) {
+        if (i > 0) id += "|";
+        if (strings[i]) id += (const char*)strings[i];
+      }
+    }
+    return id;
+  }
+
+  /* A hash of @source stable between runs (FNV-1a, 64 bits) */
+  static GLuint64 hashSource(const std::string& source) {
+    GLuint64 hash = 14695981039346656037ull;
+    for (size_t i = 0; i < source.size(); ++i) {
+      hash ^= (unsigned char)source[i];
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  /* The programs linked so far (see `reload`), keyed by the hash of their sources */
+  static std::unordered_map<GLuint64, Shader>& programs() {
+    static std::unordered_map<GLuint64, Shader> linked;
+    return linked;
+  }
+
+  /* Reflect all active uniforms of the linked program into a new table
+  ** Array uniforms (`name[0]`) are also stored by their base name.
+  ** The table is shared by all copies of this shader (it is filled in place, so the
+  ** copies made before `finish` see it too). */
+  void reflectUniforms() {
+    uniforms->by_name.clear();
+    uniforms->by_id.clear();
+
+    GLint num_uniforms = 0, max_length = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &num_uniforms);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::vector<GLchar> buffer(max_length + 1);
+    for (GLint i = 0; i < num_uniforms; ++i) {
+      GLsizei length = 0;
+      GLint size = 0;
+      GLenum type = 0;
+      glGetActiveUniform(program, i, buffer.size(), &length, &size, &type, buffer.data());
+      std::string name(buffer.data(), length);
+
+      GLint location = glGetUniformLocation(program, name.c_str());
+      lookup_count()++;
+      if (location < 0) continue;  // Uniforms in blocks have no location
+      uniforms->by_name[name] = location;
+      if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+        uniforms->by_name[name.substr(0, name.size() - 3)] = location;
+    }
+  }
+
+  /* Attach the uniform block @name (if the program uses it) to @binding */
+  void bindUniformBlock(const char* name, UniformBlockBinding binding) {
+    GLuint index = glGetUniformBlockIndex(program, name);
+    if (index != GL_INVALID_INDEX)
+      glUniformBlockBinding(program, index, binding);
+  }
+
+  /* The variants built so far (see `variant`), keyed by paths and features */
+  static std::unordered_map<std::string, Shader>& variants() {
+    static std::unordered_map<std::string, Shader> cache;
+    return cache;
+  }
+
+  /* Insert one `#define` per feature after the `#version` line of @code, and the
+  ** constants shared with the C++ side (`NUM_CASCADES`)
+  ** The `#line` directive keeps the line numbers of the compile errors. */
+  static std::string injectDefines(const std::string& code, const ShaderDefines& defines) {
+    std::string block = "#define NUM_CASCADES " + std::to_string(NUM_SHADOW_CASCADES) + "\n";
+    for (GLuint i = 0; i < defines.size(); ++i)
+      block += "#define " + defines[i] + "\n";
+
+    size_t version = code.find("#version");
+    if (version == std::string::npos) return block + "#line 1\n" + code;
+    size_t end = code.find('\n', version);
+    if (end == std::string::npos) return code + "\n" + block;
+
+    GLuint line = 2 + std::count(code.begin(), code.begin() + end, '\n');
+    return code.substr(0, end + 1) + block + "#line " + std::to_string(line) + "\n" + code.substr(end + 1);
+  }
+
+  /* The counter behind `getLookupCount` */
+  static GLuint& lookup_count() {
+    static GLuint count = 0;
+    return count;
+  }
+
+  /* Load code string of the shader @path
+  ** The sources embedded at build time are looked up by file name, no file is read.
+  ** With SHADER_HOT_RELOAD (or without embedded sources) the file @path is read
+  ** first, the embedded source is the fallback.
   ** PRIVATE member only viewed inside this class. */
   std::string loadCode(const char* path, ShaderCompileOption compile_option) {
-    // @param shader_code: The string of shader code
-    // @param shader_file: The string stream of shader code
     std::string shader_code;
-    std::ifstream shader_file;
-
-    // Throw exceptions (if error occurs)
-    shader_file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    try {  // Open and read code string
-      shader_file.open(path);
-      std::stringstream shader_stream;
-      shader_stream << shader_file.rdbuf();
-      shader_file.close();
-      shader_code = shader_stream.str();
-    } catch (const std::ifstream::failure& err) {  // Vertex or fragment shader file opening error
-      std::print(stderr, "ERROR: Cannot open shader file!\n");
-      exit(1);
+#if defined(SHADER_HOT_RELOAD) || !defined(SHADERS_EMBEDDED)
+    if (readCode(path, shader_code)) return shader_code;
+#endif
+    if (embeddedCode(path, shader_code)) return shader_code;
+#if defined(SHADERS_EMBEDDED) && !defined(SHADER_HOT_RELOAD)
+    if (readCode(path, shader_code)) return shader_code;
+#endif
+
+    // Vertex or fragment shader file opening error
+    std::print(stderr, "ERROR: Cannot open shader file {}!\n", path);
+    exit(1);
+  }
+
+  /* Look up the source of @path (by its file name) in the embedded shaders */
+  static GLboolean embeddedCode(const char* path, std::string& shader_code) {
+#ifdef SHADERS_EMBEDDED
+    std::string_view name(path);
+    size_t slash = name.find_last_of("/\\");
+    if (slash != std::string_view::npos) name.remove_prefix(slash + 1);
+    for (size_t i = 0; i < sizeof(embedded_shaders) / sizeof(EmbeddedShader); ++i) {
+      if (embedded_shaders[i].name == name) {
+        shader_code = std::string(embedded_shaders[i].source);
+        return true;
+      }
     }
+#endif
+    return false;
+  }
 
-    return shader_code;
+  /* Read the source of @path from the file (false if it cannot be read) */
+  static GLboolean readCode(const char* path, std::string& shader_code) {
+    std::ifstream shader_file(path, std::ios::binary);
+    if (!shader_file) return false;
+    std::stringstream shader_stream;
+    shader_stream << shader_file.rdbuf();
+    shader_code = shader_stream.str();
+    return true;
   }
 
   /* Check whether the compilation succeed.
@@ -244,6 +667,12 @@ class Shader {
 
   /* Shader function type */
   shaderFuncType func;
+
+  /* The locations of active uniforms (see `reflectUniforms`) */
+  std::shared_ptr<UniformTable> uniforms;
+
+  /* The state of the link (see `submit` and `finish`) */
+  std::shared_ptr<ShaderLink> link;
 };
 
 #endif
\ No newline at end of file
@@ -13,21 +13,58 @@
 
 #include <GL/glew.h>
 
-/* CLASS: Showmap */
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "gl_state.h"
+
+/* CLASS: Showmap
+** The shadow cascades lay side by side in one depth texture (an atlas of @num_cascades
+** square tiles), so the main shader samples a single texture.
+** The static shadow casters are rendered into a cached atlas. A cascade of the cache
+** is kept while its light does not move and the static scene does not change (see
+** `isCached`). Every frame the cached atlas is copied into the shadow map and the
+** dynamic casters are drawn over it (see `bind`). */
 class ShadowMap {
  public:
-  /* Default constructor & Constructor */
-  ShadowMap(GLuint _width, GLuint _height)
-      : width(_width),
-        height(_height) {  // Do initialization
+  /* Default constructor & Constructor
+  ** @param _size: The width and height of one cascade */
+  ShadowMap(GLuint _size, GLuint _num_cascades)
+      : size(_size),
+        num_cascades(_num_cascades),
+        width(_size * _num_cascades),
+        height(_size),
+        cached(_num_cascades, false),
+        cached_light_spaces(_num_cascades) {  // Do initialization
     init();
   }
 
-  /* Bind the buffer (shadow map) */
+  /* Bind the buffer (shadow map)
+  ** The depth is initialized with the static casters of the cache */
   void bind() {
-    glViewport(0, 0, width, height);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, staticMapFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthMapFBO);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
     glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+  }
+
+  /* Bind the buffer of the static casters
+  ** Call `clearCascade` before drawing a cascade, and `setCached` after */
+  void bindStatic() {
+    glBindFramebuffer(GL_FRAMEBUFFER, staticMapFBO);
+  }
+
+  /* Render into the tile of @cascade (in the bound buffer) */
+  void setCascade(const GLuint& cascade) {
+    glViewport(cascade * size, 0, size, size);
+  }
+
+  /* Clear the tile of @cascade only (in the bound buffer) */
+  void clearCascade(const GLuint& cascade) {
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(cascade * size, 0, size, size);
     glClear(GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
   }
 
   /* Unbind the buffer (shadow map) */
@@ -35,11 +72,27 @@ class ShadowMap {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
   }
 
+  /* Whether the cache holds the static casters of @cascade seen from @light_space */
+  GLboolean isCached(const GLuint& cascade, const glm::mat4& light_space) {
+    return cached[cascade] && light_space == cached_light_spaces[cascade];
+  }
+
+  /* Mark the cache of @cascade valid for @light_space */
+  void setCached(const GLuint& cascade, const glm::mat4& light_space) {
+    cached[cascade] = true;
+    cached_light_spaces[cascade] = light_space;
+  }
+
+  /* Drop the cache of all cascades (call it when the static casters change) */
+  void invalidate() { cached.assign(num_cascades, false); }
+
   /* Returns the private members
    ** We set the shadow map settings private, because they are not supposed to be
    ** editted easily. If they need to be editted, call the `set*` functions, which makes
    ** sure you edit them on purpose, instead of unconsciously. */
   const GLuint getDepthMap() { return depthMap; }
+  const GLuint getSize() { return size; }
+  const GLuint getNumCascades() { return num_cascades; }
   const GLuint getWidth() { return width; }
   const GLuint getHeight() { return height; }
 
@@ -47,19 +100,30 @@ class ShadowMap {
   /* PRIVATE MEMBER:
   ** Do Initialization */
   void init() {
+    initDepthMap(depthMap, depthMapFBO);
+    initDepthMap(staticMap, staticMapFBO);
+  }
+
+  /* PRIVATE MEMBER:
+  ** Create a depth texture and the frame buffer rendering into it */
+  void initDepthMap(GLuint& texture, GLuint& FBO) {
     // Generate frame buffers
-    glGenFramebuffers(1, &depthMapFBO);
+    glGenFramebuffers(1, &FBO);
 
     // Generate and bind textures
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
+    glGenTextures(1, &texture);
+    glState().bindTexture(texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
                  width, height, 0, GL_DEPTH_COMPONENT,
                  GL_FLOAT, 0);
 
     // Texture parameters settings
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    // The texture is sampled with depth comparison (`sampler2DShadow`): with linear
+    // filtering each lookup returns the 2x2 PCF of the compared texels
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 
@@ -67,20 +131,28 @@ class ShadowMap {
     glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, white);
 
     // Bind and draw frame buffer (then unbind it)
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
   }
 
   /* PRIVATE MEMBERS:
-  ** The width and height of the shadow map */
+  ** The size of one cascade, the number of cascades and the size of the atlas */
+  GLuint size, num_cascades;
   GLuint width, height;
 
   /* PRIVATE MEMBERS
   ** The depthMap and its FBO */
   GLuint depthMapFBO, depthMap;
+
+  /* PRIVATE MEMBERS
+  ** The cached depth of the static casters, its FBO, and whether each cascade of it
+  ** is valid (and the light it was drawn from) */
+  GLuint staticMapFBO, staticMap;
+  std::vector<GLboolean> cached;
+  std::vector<glm::mat4> cached_light_spaces;
 };
 
 #endif
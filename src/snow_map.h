@@ -0,0 +1,223 @@
+/*******************************************************************************
+** Software License Agreement (GNU GENERAL PUBLIC LICENSE)
+**
+** Copyright 2016-2017  Peiyu Liao (enzoliao95@gmail.com). All rights reserved.
+** Copyright 2016-2017  Yaohong Wu (wuyaohongdio@gmail.com). All rights reserved.
+**
+** LICENSE INFORMATION (GPL)
+** SEE `LICENSE` FILE.
+*******************************************************************************/
+
+#ifndef _SNOW_MAP_H_
+#define _SNOW_MAP_H_
+
+#include <GL/glew.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "gl_state.h"
+#include "shader.hpp"
+
+/* CLASS: Snow accumulation map
+** A world-space snow depth map covering a window of the x-z plane around the player.
+** Every frame the previous map is scrolled (the window follows the player) and decays,
+** then the impact points of particles are splatted into it with additive point
+** rendering. Everything stays on the GPU, no readback at all. */
+class SnowMap {
+ public:
+  /* Default constructor & Constructor
+  ** @param _unit: The texture unit the snow map is bound to
+  ** @param _width, _height: The resolution of the map (x and z)
+  ** @param _size_x, _size_z: The size of the covered window in world units */
+  SnowMap(const Shader& _splat_shader,
+          const Shader& _scroll_shader,
+          GLuint _unit,
+          GLuint _width = 256,
+          GLuint _height = 512,
+          GLfloat _size_x = 128.0f,
+          GLfloat _size_z = 256.0f)
+      : splat_shader(_splat_shader),
+        scroll_shader(_scroll_shader),
+        unit(_unit),
+        width(_width),
+        height(_height),
+        size_x(_size_x),
+        size_z(_size_z),
+        decay_rate(0.02f),
+        splat_amount(0.1f),
+        splat_size(3.0f),
+        current(0) {  // Do initialization
+    init();
+  }
+
+  /* Returns the private members
+  ** We set the snow map settings private, because they are not supposed to be
+  ** editted easily. If they need to be editted, call the `set*` functions, which makes
+  ** sure you edit them on purpose, instead of unconsciously. */
+  const GLuint getSnowMap() { return snow_maps[current]; }
+  const GLuint getUnit() { return unit; }
+  const GLuint getWidth() { return width; }
+  const GLuint getHeight() { return height; }
+  const GLfloat getDecayRate() { return decay_rate; }
+  const GLfloat getSplatAmount() { return splat_amount; }
+
+  /* The covered region: (origin x, origin z, size x, size z) */
+  const glm::vec4 getRegion() { return glm::vec4(origin.x, origin.y, size_x, size_z); }
+
+  /* Set some private members */
+  void setDecayRate(const GLfloat _decay_rate) { decay_rate = _decay_rate; }
+  void setSplatAmount(const GLfloat _splat_amount) { splat_amount = _splat_amount; }
+  void setSplatSize(const GLfloat _splat_size) { splat_size = _splat_size; }
+
+  /* UPDATE the snow map
+  ** @param impacts: The impact points of particles (world space)
+  ** @param center: The position of the player (the window follows it)
+  ** @param dt: The time passed (between 2 frames)
+  ** The current map is left bound to @unit. */
+  void update(const std::vector<glm::vec3>& impacts,
+              const glm::vec3& center,
+              const GLfloat& dt) {
+    // Compute the new origin, snapped to texels so that scrolling does not blur the map
+    // Most of the window lays ahead of the player (the player moves along -z)
+    glm::vec2 texel(size_x / width, size_z / height);
+    glm::vec2 new_origin(floor((center.x - 0.5f * size_x) / texel.x) * texel.x,
+                         floor((center.z - 0.75f * size_z) / texel.y) * texel.y);
+    glm::vec2 shift((new_origin.x - origin.x) / size_x,
+                    (new_origin.y - origin.y) / size_z);
+    origin = new_origin;
+
+    GLuint previous = current;
+    current = 1 - current;
+    glBindFramebuffer(GL_FRAMEBUFFER, FBOs[current]);
+    glViewport(0, 0, width, height);
+    glState().disable(GL_DEPTH_TEST);
+    glState().disable(GL_BLEND);
+
+    // Scroll and decay the previous map (full screen quad)
+    scroll_shader.install();
+    glState().bindTexture(unit, snow_maps[previous]);
+    scroll_shader.setUniform1i("previousMap", unit);
+    scroll_shader.setUniform3f("shiftDecay", glm::vec3(shift, exp(-decay_rate * dt)));
+    glState().bindVertexArray(quad_VAO);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    // Splat the impacts with additive point rendering
+    if (!impacts.empty()) {
+      glBindBuffer(GL_ARRAY_BUFFER, impact_VBO);
+      if (impacts.size() > impact_capacity) {
+        impact_capacity = impacts.size();
+        glBufferData(GL_ARRAY_BUFFER, impact_capacity * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
+      }
+      glBufferSubData(GL_ARRAY_BUFFER, 0, impacts.size() * sizeof(glm::vec3), impacts.data());
+
+      splat_shader.install();
+      splat_shader.setUniform4f("region", getRegion());
+      splat_shader.setUniform1f("amount", splat_amount);
+      splat_shader.setUniform1f("pointSize", splat_size);
+      glState().enable(GL_BLEND);
+      glState().blendFunc(GL_ONE, GL_ONE);
+      glState().enable(GL_PROGRAM_POINT_SIZE);
+      glState().bindVertexArray(impact_VAO);
+      glDrawArrays(GL_POINTS, 0, impacts.size());
+    }
+
+    // The depth test and blending are set by the next pass (see `renderScene`)
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Bind the current map for the main pass
+    glState().bindTexture(unit, snow_maps[current]);
+  }
+
+ private:
+  /* PRIVATE MEMBER:
+  ** Do Initialization */
+  void init() {
+    origin = glm::vec2(0.0f, 0.0f);
+    impact_capacity = 0;
+
+    // Two maps for ping-pong (read the previous one, write the current one)
+    glGenFramebuffers(2, FBOs);
+    glGenTextures(2, snow_maps);
+    for (GLuint i = 0; i < 2; ++i) {
+      glState().bindTexture(snow_maps[i]);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, width, height, 0, GL_RED, GL_FLOAT, 0);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+      // Outside the window there is no snow (the border color is zero)
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+      glBindFramebuffer(GL_FRAMEBUFFER, FBOs[i]);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, snow_maps[i], 0);
+      glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+      glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glState().bindTexture(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // The full screen quad used to scroll the map
+    GLfloat quad[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+    glGenVertexArrays(1, &quad_VAO);
+    glGenBuffers(1, &quad_VBO);
+    glState().bindVertexArray(quad_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, quad_VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
+
+    // The impact points (updated every frame)
+    glGenVertexArrays(1, &impact_VAO);
+    glGenBuffers(1, &impact_VBO);
+    glState().bindVertexArray(impact_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, impact_VBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glState().bindVertexArray(0);
+  }
+
+  /* PRIVATE MEMBERS
+  ** @param splat_shader: Splats impact points into the map
+  ** @param scroll_shader: Scrolls and decays the previous map */
+  Shader splat_shader, scroll_shader;
+
+  /* PRIVATE MEMBER
+  ** The texture unit the snow map is bound to */
+  GLuint unit;
+
+  /* PRIVATE MEMBERS:
+  ** The resolution of the map */
+  GLuint width, height;
+
+  /* PRIVATE MEMBERS:
+  ** The size of the covered window (world units) */
+  GLfloat size_x, size_z;
+
+  /* PRIVATE MEMBER:
+  ** The x-z coordinates of the corner of the covered window */
+  glm::vec2 origin;
+
+  /* PRIVATE MEMBERS
+  ** @param decay_rate: The snow depth decays by `exp(-decay_rate * dt)` every frame
+  ** @param splat_amount: The snow depth added by one impact (at its center)
+  ** @param splat_size: The size of one impact in texels */
+  GLfloat decay_rate, splat_amount, splat_size;
+
+  /* PRIVATE MEMBERS
+  ** The two snow maps and their FBOs, and the index of the current one */
+  GLuint FBOs[2], snow_maps[2];
+  GLuint current;
+
+  /* PRIVATE MEMBERS
+  ** The VAOs and VBOs of the full screen quad and the impact points */
+  GLuint quad_VAO, quad_VBO, impact_VAO, impact_VBO;
+
+  /* PRIVATE MEMBER
+  ** The number of impact points the impact VBO can hold */
+  GLuint impact_capacity;
+};
+
+#endif
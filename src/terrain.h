@@ -21,6 +21,7 @@
 #include <string>
 #include <vector>
 
+#include "gl_state.h"
 #include "hmap_generator.h"
 #include "objects.h"
 
@@ -68,20 +69,12 @@ class Terrain : public Object {
   /* DRAW function */
   void draw(Shader shader) {
     shader.install();
-    glBindVertexArray(VAO);
-    shader.setUniformMatrix4fv("model", model2world);
+    glState().bindVertexArray(VAO);
+    // Bind the texture (if not NULL) and upload the model matrix
+    setMaterial(shader, model2world);
 
-    // Bind the texture (if not NULL)
-    if (texture_ptr) {
-      texture_ptr->bind(texture_ptr->getUnit());
-      shader.setUniform1i("material.diffuse1", texture_ptr->getUnit());
-    }
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    // The EBO is bound to the VAO (see `setup`)
     glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    shader.uninstall();
   }
 
   /* IMPORTANT PUBLIC FUNCTION
@@ -96,7 +89,7 @@ class Terrain : public Object {
     glGenBuffers(1, &EBO);
 
     // Bind vertex array
-    glBindVertexArray(VAO);
+    glState().bindVertexArray(VAO);
 
     // Bind vertex VBO buffer data
     glBindBuffer(GL_ARRAY_BUFFER, vert_VBO);
@@ -123,7 +116,20 @@ class Terrain : public Object {
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
-    glBindVertexArray(0);
+    glState().bindVertexArray(0);
+
+    // The depth pass reads the positions only
+    setupDepthVAO(vert_VBO, 0, EBO);
+    bounds = BoundingSphere::fromPoints(&vertices[0].x, vertices.size(), 3);
+  }
+
+  /* PUBLIC FUNCTION
+  ** Whether the given x-z coordinates (terrain space) lay on this terrain.
+  ** Call this function before `getAltitude`, which exits on illegal coordinates. */
+  GLboolean contains(const GLfloat& xterrain,
+                     const GLfloat& zterrain) {
+    return xterrain >= 0.0f && xterrain < size &&
+           zterrain >= 0.0f && zterrain < size;
   }
 
   /* PUBLIC FUNCTION
@@ -162,6 +168,11 @@ class Terrain : public Object {
     return altitude;
   }
 
+ protected:
+  void drawGeometry(const GLuint& count) {
+    glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, count);
+  }
+
  private:
   /* PRIVATE MEMBER
   ** Generates all parameters needed. */
@@ -18,6 +18,8 @@
 
 #include <string>
 
+#include "gl_state.h"
+
 /* The texture type
 ** Determined by image extension name
 ** Attention: The enum options after TEXTURE_JPG
@@ -69,7 +71,7 @@ class Texture {
     // Make room for our texture
     glGenTextures(1, &id);
     // Tell OpenGL which texture to edit and map the image to the texture
-    glBindTexture(GL_TEXTURE_2D, id);
+    glState().bindTexture(id);
 
     // ----------------------------------------------------------------------------------------
     // Specify a two-dimensional texture image
@@ -92,20 +94,18 @@ class Texture {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glState().bindTexture(0);
     SDL_FreeSurface(surface);
   }
 
   /* The function binds this texture */
   void bind(const int& index = 0) {
-    glActiveTexture(GL_TEXTURE0 + index);
-    glBindTexture(GL_TEXTURE_2D, id);
+    glState().bindTexture(index, id);
   }
 
   /* The function unbinds this texture */
   void unbind() {
-    glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glState().bindTexture(unit, 0);
   }
 
   /* Returns the private members
@@ -178,7 +178,7 @@ GLuint TextureFromFileDir(const char* path, std::string directory) {
   // Assign texture to ID
   GLuint textureID;
   glGenTextures(1, &textureID);
-  glBindTexture(GL_TEXTURE_2D, textureID);
+  glState().bindTexture(textureID);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
                width, height, 0,
                GL_RGB, GL_UNSIGNED_BYTE, surface->pixels);
@@ -190,7 +190,7 @@ GLuint TextureFromFileDir(const char* path, std::string directory) {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  glState().bindTexture(0);
 
   SDL_FreeSurface(surface);
   return textureID;
@@ -206,7 +206,7 @@ GLuint TextureFromFile(const char* filename) {
   // Assign texture to ID
   GLuint textureID;
   glGenTextures(1, &textureID);
-  glBindTexture(GL_TEXTURE_2D, textureID);
+  glState().bindTexture(textureID);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
                width, height, 0,
                GL_RGB, GL_UNSIGNED_BYTE, surface->pixels);
@@ -217,7 +217,7 @@ GLuint TextureFromFile(const char* filename) {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  glState().bindTexture(0);
 
   SDL_FreeSurface(surface);
   return textureID;
@@ -0,0 +1,109 @@
+/*******************************************************************************
+** Software License Agreement (GNU GENERAL PUBLIC LICENSE)
+**
+** Copyright 2016-2017  Peiyu Liao (enzoliao95@gmail.com). All rights reserved.
+** Copyright 2016-2017  Yaohong Wu (wuyaohongdio@gmail.com). All rights reserved.
+**
+** LICENSE INFORMATION (GPL)
+** SEE `LICENSE` FILE.
+*******************************************************************************/
+
+#ifndef _UNIFORM_BLOCKS_H_
+#define _UNIFORM_BLOCKS_H_
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "shader.hpp"
+
+/* STRUCT: The data shared by all programs in one frame
+** Mirrors the std140 block `FrameData` in the shaders, keep both in the same order!
+** A vec3 followed by a float shares one 16-byte slot in std140.
+** @param lightSpace: The light space matrix of each shadow cascade (`NUM_SHADOW_CASCADES`, see `shader.hpp`)
+** @param cascadeSplits: The view distance where each cascade ends */
+struct FrameData {
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::mat4 viewProj;
+  glm::mat4 lightSpace[NUM_SHADOW_CASCADES];
+  glm::vec3 viewPos;
+  GLfloat time;
+  glm::vec3 lightDirection;
+  GLfloat padding0;
+  glm::vec3 lightAmbient;
+  GLfloat padding1;
+  glm::vec3 lightDiffuse;
+  GLfloat padding2;
+  glm::vec3 lightSpecular;
+  GLfloat padding3;
+  glm::vec4 cascadeSplits;
+};
+
+/* STRUCT: The data of the object being drawn
+** Mirrors the std140 block `ObjectData` in the shaders.
+** @param normalMatrix: The inverse transpose of the model matrix (upper 3x3 used),
+** computed once per draw instead of once per vertex */
+struct ObjectData {
+  glm::mat4 model;
+  glm::mat4 normalMatrix;
+  GLfloat kd, ks, shininess;
+  GLfloat padding;
+};
+
+/* CLASS: Uniform buffer
+** A buffer backing the uniform block @Block, bound to its binding point once.
+** The buffer is created on the first update (the GL context must exist then). */
+template <typename Block>
+class UniformBuffer {
+ public:
+  /* Default constructor & Constructor */
+  UniformBuffer(UniformBlockBinding _binding)
+      : binding(_binding),
+        UBO(0) {  // Do nothing here
+  }
+
+  /* Returns the private members */
+  const GLuint getBuffer() { return UBO; }
+  const UniformBlockBinding getBinding() { return binding; }
+
+  /* Upload the whole block */
+  void update(const Block& block) {
+    if (UBO == 0) init();
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+ private:
+  /* PRIVATE MEMBER
+  ** Create the buffer and attach it to the binding point */
+  void init() {
+    glGenBuffers(1, &UBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, UBO);
+  }
+
+  /* PRIVATE MEMBERS
+  ** @param binding: The binding point of the block
+  ** @param UBO: The uniform buffer */
+  UniformBlockBinding binding;
+  GLuint UBO;
+};
+
+/* The buffer of `FrameData`, updated once per frame (see `updateScene`)
+** The buffers are `inline`: one UBO each for the whole program */
+inline UniformBuffer<FrameData>& frameDataBuffer() {
+  static UniformBuffer<FrameData> buffer(FRAME_DATA_BINDING);
+  return buffer;
+}
+
+/* The buffer of `ObjectData`, updated by every object before it draws */
+inline UniformBuffer<ObjectData>& objectDataBuffer() {
+  static UniformBuffer<ObjectData> buffer(OBJECT_DATA_BINDING);
+  return buffer;
+}
+
+#endif
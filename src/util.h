@@ -1,8 +1,10 @@
 #pragma once
 #include <GL/glew.h>
 
+#include "frustum.h"
 #include "light.hpp"
 #include "objects.h"
+#include "render_queue.h"
 #include "terrain.h"
 
 /* forward declaration */
@@ -11,6 +13,9 @@ class Texture;
 class Model;
 class ParticleSystem;
 class ShadowMap;
+class SnowMap;
+class GrassField;
+class Impostor;
 class Billboard;
 
 // Window
@@ -25,6 +30,15 @@ Shader debug_depth_shader;
 Shader billboard_shader;
 Shader go_shader;
 Shader win_shader;
+Shader snow_splat_shader;
+Shader snow_scroll_shader;
+Shader grass_shader;
+Shader impostor_bake_shader;
+Shader impostor_shader;
+
+// The sources of the main shader variants (see `selectMainShader`)
+const char* main_vert_path = "../assets/shaders/main.vert";
+const char* main_frag_path = "../assets/shaders/main.frag";
 
 Camera camera(
     glm::vec3(0.0f, 15.0f, 25.0f),
@@ -67,7 +81,6 @@ Cube cube(0.7, 0.1, 30);
 Square square(0.5, 0.1, 30);
 Square path(0.9, 0.0, 10);
 Ball ball(1.0, 40, 40, 0.0, 0.7, 50);
-Model grass;
 Model wood;
 Model tree;
 Model house;
@@ -83,7 +96,12 @@ glm::vec3 lightPos;
 glm::vec3 lightDir;
 
 // Game related
+// Define BARRIER_STRESS_MODE to test with 10k barrier rows
+#ifdef BARRIER_STRESS_MODE
+Barriers barriers(1.0f, 0.0f, 30.0f, 10000);
+#else
 Barriers barriers;
+#endif
 
 GLuint score = 0;
 
@@ -105,12 +123,63 @@ GLfloat offset_z = 0;
 // Terrains
 Terrain mini_terrain("../assets/terrains/test.bmp");
 
-// Particle system
+// Particle system (shared pool) and its emitters
 ParticleSystem* ps;
+GLuint snow_emitter;
+GLuint powder_emitter;
+GLuint impact_emitter;
 
 // Shadow Map
 ShadowMap* sm;
-const GLuint shadow_map_width = 1024, shadow_map_height = 1024;
+// The size of one shadow cascade (the cascades lay side by side in the shadow map)
+const GLuint shadow_cascade_size = 1024;
+// Each cascade follows the camera in steps of this many texels (of the cascade)
+const GLuint shadow_snap_texels = 64;
+// The distance to the camera where the shadows end (the far plane of the camera)
+const GLfloat shadow_distance = 100.0f;
+// The light space matrix and the bounding sphere (center, half extent) of each cascade
+// in the frame (see `updateShadowCascades`)
+glm::mat4 lightSpaces[NUM_SHADOW_CASCADES];
+glm::vec4 cascadeSpheres[NUM_SHADOW_CASCADES];
+// The light frustum of the cascade being rendered (the casters outside are culled)
+Frustum shadow_frustum;
+
+/* ENUM TYPE
+** The shadow casters drawn by `renderScene` in the depth pass
+** The static ones are cached by the shadow map (see `renderShadowMap`) */
+enum CasterSet {
+  CASTERS_ALL,
+  CASTERS_STATIC,   // Trees, terrains, path and the snow house
+  CASTERS_DYNAMIC   // The snowball and the barriers
+};
+
+// Snow accumulation map (fed by particle impacts, see main.frag)
+SnowMap* snow_map;
+const GLuint snow_map_unit = 11;
+
+// Procedural grass field (one segment per scene part, slot 0 for A and 1 for B)
+GrassField* grass_field;
+
+// The view frustum of the camera (updated once per frame)
+Frustum camera_frustum;
+
+// The objects drawn and culled by the frusta in the frame, per pass (see `isVisible`)
+CullStats main_cull_stats, depth_cull_stats;
+
+// The placements of the trees shown (see `updatePlantInstances`) and the level of
+// detail of each one (see `updateLods`)
+std::vector<glm::mat4> tree_instances;
+std::vector<GLuint> tree_lods;
+
+// The trees farther than `impostor_distance` are drawn by `tree_impostor` (see `updateLods`)
+Impostor* tree_impostor;
+std::vector<GLboolean> tree_impostors;
+const GLfloat impostor_distance = 45.0f;
+const GLuint impostor_albedo_unit = 12;
+const GLuint impostor_normal_unit = 13;
+
+// The draws of the pass being rendered (rebuilt by `renderScene`)
+RenderQueue render_queue;
 
 // Billboard
 Billboard* billboard;
@@ -128,14 +197,10 @@ GLfloat factor = 0.0f;
 GLfloat dist_total = 0.0f;
 GLfloat dist_delta = 0.0f;  // dist_delta < 100
 
-// For transforming models like grass, trees, etc.
-GLuint num_grass = 20;
-std::vector<glm::mat4> grassModelMatsA;  // transformation matrices for part A
-std::vector<glm::mat4> grassModelMatsB;  // transformation matrices for part B
-
+// For transforming models like trees, etc.
 GLuint num_tree = 4;
-std::vector<glm::mat4> treeModelMatsA;
-std::vector<glm::mat4> treeModelMatsB;
+std::vector<glm::mat4> treeModelMatsA;  // transformation matrices for part A
+std::vector<glm::mat4> treeModelMatsB;  // transformation matrices for part B
 
 glm::mat4 pathModelMatA;
 glm::mat4 pathModelMatB;